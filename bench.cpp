@@ -0,0 +1,530 @@
+// Benchmarks of the calculator, run with "make bench" (Google Benchmark, f.e. BENCH_ARGS=--benchmark_filter=Parse)
+//
+// Every benchmark runs over one synthetic corpus of expressions and reports expressions per second, the time per Node
+// and the heap allocations per expression, so parsing, the evaluation backends and the whole line path can be compared
+
+#define SIMPLEPARSER_NO_MAIN
+#include "parser.cpp"
+
+#include <benchmark/benchmark.h>
+
+#include <new>
+#include <random>
+
+/******************************************************************************/
+
+// Every allocation of the process is counted, the benchmarks report the difference per expression
+#ifdef SIMPLEPARSER_STATS
+// The stats build replaces operator new itself
+static std::atomic<std::uint64_t>& allocations = stats::counters().allocations;
+#else
+// The replacements stay out of line, GCC would otherwise pair the inlined free() with new and warn about a mismatch
+static std::atomic<std::uint64_t> allocations{ 0 };
+
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+#endif
+
+/******************************************************************************/
+
+// Synthetic inputs, each corpus stresses another part: long operator chains, recursion, many variables or assignments
+struct Corpus {
+    std::string name;
+    std::vector<std::string> lines;
+    std::size_t variables;
+};
+
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(std::size_t variables) : variables(variables) { }
+
+    //"v3 + 1.25 + v7 + ..." with terms operands
+    std::string flat_sum(std::size_t terms) {
+        std::string text = operand();
+        for (std::size_t i = 1; i < terms; ++i)
+            text += (coin() ? " + " : " - ") + operand();
+        return text;
+    }
+
+    //"v1 * (2.5 + (v4 * (1.5 - ...)))", every level opens a group, so parser and stack go depth deep
+    std::string deep_groups(std::size_t depth) {
+        std::string text = operand();
+        for (std::size_t i = 0; i < depth; ++i)
+            text = operand() + (coin() ? " * (" : " + (") + text + ")";
+        return text;
+    }
+
+    //"v2 * 1.001 / v5 ^ 1 && ..." with factors operands on the product level
+    std::string wide_product(std::size_t factors) {
+        static const char* operators[] = { " * ", " / ", " * ", " && ", " || " };
+        std::string text = operand();
+        for (std::size_t i = 1; i < factors; ++i)
+            text += operators[pick(5)] + operand();
+        return text;
+    }
+
+    //Only variables, no constants that the optimizer could fold
+    std::string variable_sum(std::size_t terms) {
+        std::string text = variable();
+        for (std::size_t i = 1; i < terms; ++i)
+            text += (coin() ? " + " : " * ") + variable();
+        return text;
+    }
+
+    //One statement of a script, factors close to 1 keep the values finite over many runs
+    std::string assignment() {
+        static const char* operators[] = { " = ", " += ", " -= ", " *= ", " /= " };
+        std::size_t op = pick(5);
+        std::string value = op >= 3 ? "1.0001" : variable() + " * 0.5 + " + operand();
+        return variable() + operators[op] + value;
+    }
+
+    //"c37 = c5 * 0.5 + v5 * 1.25", formula index of a sheet with one column per input: it reads one of the last rows of
+    //its column and the input of the column, so a changed input only reaches the formulas of its own column
+    std::string formula(std::size_t index) {
+        std::size_t column = index % variables, row = index / variables;
+        std::string input = "v" + std::to_string(column);
+        std::size_t back = 1 + pick(std::min<std::size_t>(row, 4));
+        std::string read = row == 0 ? input : "c" + std::to_string(index - variables * back);
+        return "c" + std::to_string(index) + " = " + read + " * 0.5 + " + input + " * 1.25";
+    }
+
+    //"(v3 * pi + 3.25) * (v9 / 1.25 - v1) + v5", two of the 16 subexpressions every line of a rule file shares with
+    //others, combined with one operand of its own
+    std::string rule() {
+        std::size_t first = pick(8), second = pick(8);
+        return "(v" + std::to_string(first) + " * pi + " + std::to_string(first) + ".25) * (v" +
+               std::to_string(second + 8) + " / 1.25 - v" + std::to_string(second) + ") + " + operand();
+    }
+
+    //"v4 || (...)" or "(v9 - v9) && (...)" around a wide product: the guard decides the rule before its right operand
+    std::string guarded_rule(std::size_t factors) {
+        std::string guard = variable();
+        guard = coin() ? guard + " || (" : "(" + guard + " - " + guard + ") && (";
+        return guard + wide_product(factors) + ")";
+    }
+
+private:
+    std::string variable() {
+        return "v" + std::to_string(pick(variables));
+    }
+
+    std::string operand() {
+        return coin() ? variable() : std::to_string(1 + pick(100)) + ".25";
+    }
+
+    bool coin() {
+        return random() & 1;
+    }
+
+    std::size_t pick(std::size_t count) {
+        return random() % count;
+    }
+
+    std::size_t variables;
+    std::mt19937 random{ 42 };
+};
+
+const std::vector<Corpus>& corpora() {
+    static const std::vector<Corpus> all = [] {
+        const std::size_t lines = 1000;
+        std::vector<Corpus> result;
+        CorpusGenerator generator(16);
+        auto make = [&](std::string name, std::size_t variables, auto line) {
+            Corpus corpus{ std::move(name), {}, variables };
+            for (std::size_t i = 0; i < lines; ++i)
+                corpus.lines.push_back(line());
+            result.push_back(std::move(corpus));
+        };
+        make("flat_sum", 16, [&] { return generator.flat_sum(32); });
+        make("deep_groups", 16, [&] { return generator.deep_groups(24); });
+        make("wide_product", 16, [&] { return generator.wide_product(32); });
+        CorpusGenerator many(1024);
+        make("variable_heavy", 1024, [&] { return many.variable_sum(32); });
+        make("assignment_script", 16, [&] { return generator.assignment(); });
+        make("shared_rules", 16, [&] { return generator.rule(); });
+        make("guarded_rules", 16, [&] { return generator.guarded_rule(16); });
+        return result;
+    }();
+    return all;
+}
+
+//Same initial variables as main(), plus the v0 .. vN of the corpus
+SymbolTable corpus_symbols(const Corpus& corpus) {
+    SymbolTable symbols;
+    symbols.set("x", 42);
+    symbols.set("pi", 3.14159265359);
+    symbols.mark_constant("pi");
+    for (std::size_t i = 0; i < corpus.variables; ++i)
+        symbols.set("v" + std::to_string(i), 1.0 + double(i % 7) / 8);
+    return symbols;
+}
+
+//Output sink for the end to end benchmarks, formatting still happens
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        return count;
+    }
+};
+
+//Corpus parsed, optimized and compiled once for the evaluation benchmarks
+struct PreparedCorpus {
+    SymbolTable symbols;
+    std::vector<SyntaxTree> trees;
+    std::vector<CompiledExpression> programs;
+    std::size_t nodes = 0;
+};
+
+PreparedCorpus prepare(const Corpus& corpus) {
+    PreparedCorpus prepared;
+    prepared.symbols = corpus_symbols(corpus);
+    for (const std::string& line : corpus.lines) {
+        SyntaxTree tree;
+        ParserSession::local().parse(line, tree, prepared.symbols);
+        optimize(tree, prepared.symbols);
+        prepared.programs.push_back(compile(tree));
+        prepared.nodes += prepared.programs.back().instructions().size();
+        prepared.trees.push_back(std::move(tree));
+    }
+    return prepared;
+}
+
+//Throughput counters shared by all benchmarks, nodes and allocations are totals over all iterations
+void report(benchmark::State& state, std::size_t expressions, std::size_t nodes, std::size_t allocated) {
+    std::size_t total = expressions * std::size_t(state.iterations());
+    state.SetItemsProcessed(std::int64_t(total));
+    state.counters["time/node"] = benchmark::Counter(double(nodes * std::size_t(state.iterations())),
+                                                     benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    state.counters["allocs/expr"] = double(allocated) / double(total);
+}
+
+/******************************************************************************/
+
+void parse(benchmark::State& state, const Corpus& corpus) {
+    SymbolTable symbols = corpus_symbols(corpus);
+    SyntaxTree tree;
+    ParserSession& session = ParserSession::local();
+    std::size_t nodes = 0;
+    for (const std::string& line : corpus.lines) {
+        session.parse(line, tree, symbols);
+        nodes += tree.size();
+    }
+
+    std::size_t before = allocations.load();
+    for (auto _ : state) {
+        for (const std::string& line : corpus.lines) {
+            session.parse(line, tree, symbols);
+            benchmark::DoNotOptimize(tree.root());
+        }
+    }
+    report(state, corpus.lines.size(), nodes, allocations.load() - before);
+}
+
+//The corpus as one buffer through ParsedLines: parsed, optimized and compiled into one stream with one call per batch
+void parse_bulk(benchmark::State& state, const Corpus& corpus) {
+    std::string text;
+    for (const std::string& line : corpus.lines)
+        text += line + '\n';
+    SymbolTable symbols = corpus_symbols(corpus);
+    ParsedLines lines;
+    PreparedCorpus prepared = prepare(corpus);
+    std::size_t before = allocations.load();
+    for (auto _ : state) {
+        std::string_view rest = text;
+        while (!rest.empty()) {
+            rest.remove_prefix(lines.parse(rest, symbols));
+            benchmark::DoNotOptimize(lines.instructions().data());
+        }
+    }
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+void evaluate_tree(benchmark::State& state, const Corpus& corpus) {
+    PreparedCorpus prepared = prepare(corpus);
+    double* variables = prepared.symbols.data();
+    std::size_t before = allocations.load();
+    for (auto _ : state)
+        for (const SyntaxTree& tree : prepared.trees)
+            benchmark::DoNotOptimize(tree.evaluate(variables));
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+void evaluate_bytecode(benchmark::State& state, const Corpus& corpus) {
+    PreparedCorpus prepared = prepare(corpus);
+    double* variables = prepared.symbols.data();
+    std::size_t before = allocations.load();
+    for (auto _ : state)
+        for (const CompiledExpression& program : prepared.programs)
+            benchmark::DoNotOptimize(program.evaluate(variables));
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+void evaluate_jit(benchmark::State& state, const Corpus& corpus) {
+    PreparedCorpus prepared = prepare(corpus);
+    std::vector<JitFunction> functions;
+    for (const CompiledExpression& program : prepared.programs) {
+        functions.push_back(jit_compile(program));
+        if (!functions.back()) {
+            state.SkipWithError("JIT does not support every expression of this corpus");
+            return;
+        }
+    }
+    double* variables = prepared.symbols.data();
+    std::size_t before = allocations.load();
+    for (auto _ : state)
+        for (const JitFunction& function : functions)
+            benchmark::DoNotOptimize(function(variables));
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+//HotExpressions like the entries of the ExpressionCache, measured once they went past the threshold
+//Programs the JIT can not compile stay in the interpreter, native/expr is the share that tiered up
+void evaluate_hot(benchmark::State& state, const Corpus& corpus) {
+    PreparedCorpus prepared = prepare(corpus);
+    std::vector<HotExpression> programs;
+    for (const CompiledExpression& program : prepared.programs)
+        programs.emplace_back(program);
+    double* variables = prepared.symbols.data();
+    for (std::size_t i = 0; i < HotExpression::default_threshold; ++i)
+        for (HotExpression& program : programs)
+            program.evaluate(variables);
+    std::size_t before = allocations.load();
+    for (auto _ : state)
+        for (HotExpression& program : programs)
+            benchmark::DoNotOptimize(program.evaluate(variables));
+    std::size_t native = std::count_if(programs.begin(), programs.end(),
+                                       [](const HotExpression& program) { return program.is_native(); });
+    state.counters["native/expr"] = double(native) / double(programs.size());
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+//The whole corpus as one ExpressionDag, every shared subexpression is evaluated once per iteration
+//time/node is still per Node of the separate trees, dag/nodes is the share of them left after merging
+void evaluate_dag(benchmark::State& state, const Corpus& corpus) {
+    PreparedCorpus prepared = prepare(corpus);
+    ExpressionDag dag(prepared.symbols);
+    for (const std::string& line : corpus.lines)
+        dag.add(line);
+    state.counters["dag/nodes"] = double(dag.size()) / double(prepared.nodes);
+    double* variables = prepared.symbols.data();
+    dag.evaluate(variables);
+    std::size_t before = allocations.load();
+    for (auto _ : state) {
+        dag.evaluate(variables);
+        benchmark::DoNotOptimize(dag.value(0));
+    }
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+//Every expression over rows rows, the variables are columns with a different value per row
+void evaluate_batch(benchmark::State& state, const Corpus& corpus, BatchEvaluator::Logic logic,
+                    BatchPower power = BatchPower::Exact) {
+    const std::size_t rows = 1024;
+    PreparedCorpus prepared = prepare(corpus);
+    std::vector<std::vector<double>> storage(prepared.symbols.size(), std::vector<double>(rows));
+    std::vector<const double*> columns;
+    for (std::uint32_t slot = 0; slot < prepared.symbols.size(); ++slot) {
+        for (std::size_t row = 0; row < rows; ++row)
+            storage[slot][row] = prepared.symbols[slot] + double(row % 16) / 64;
+        columns.push_back(storage[slot].data());
+    }
+    std::vector<double> out(rows);
+    BatchEvaluator evaluator(batch_kernels(power), logic);
+    state.SetLabel(batch_kernels(power).name);
+
+    std::size_t before = allocations.load();
+    for (auto _ : state) {
+        for (const CompiledExpression& program : prepared.programs) {
+            evaluator.evaluate(program, columns.data(), prepared.symbols.data(), rows, out.data());
+            benchmark::DoNotOptimize(out.data());
+        }
+    }
+    report(state, corpus.lines.size() * rows, prepared.nodes * rows, allocations.load() - before);
+}
+
+//&& / || skip the right operand of a block once the left one decides all its rows
+void evaluate_batch_short_circuit(benchmark::State& state, const Corpus& corpus) {
+    evaluate_batch(state, corpus, BatchEvaluator::Logic::ShortCircuit);
+}
+
+//Same with the vector approximation of '^' (relative error up to 1e-13) instead of pow() per row
+void evaluate_batch_approximate(benchmark::State& state, const Corpus& corpus) {
+    evaluate_batch(state, corpus, BatchEvaluator::Logic::ShortCircuit, BatchPower::Approximate);
+}
+
+//Both operands of && / || for every row, through the mask kernels
+void evaluate_batch_branchless(benchmark::State& state, const Corpus& corpus) {
+    evaluate_batch(state, corpus, BatchEvaluator::Logic::Branchless);
+}
+
+//One line at a time like the sequential mode, the session cache is warm after the first iteration
+void end_to_end(benchmark::State& state, const Corpus& corpus) {
+    SymbolTable symbols = corpus_symbols(corpus);
+    NullBuffer buffer;
+    std::ostream out(&buffer);
+    PreparedCorpus prepared = prepare(corpus);
+    std::size_t before = allocations.load();
+    for (auto _ : state)
+        for (const std::string& line : corpus.lines)
+            testGrammar(line, symbols, out);
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+//Same without the cache: parse, optimize and walk the tree for every line
+void end_to_end_uncached(benchmark::State& state, const Corpus& corpus) {
+    SymbolTable symbols = corpus_symbols(corpus);
+    NullBuffer buffer;
+    std::ostream out(&buffer);
+    SyntaxTree tree;
+    ParserSession& session = ParserSession::local();
+    PreparedCorpus prepared = prepare(corpus);
+    std::size_t before = allocations.load();
+    for (auto _ : state) {
+        for (const std::string& line : corpus.lines) {
+            session.parse(line, tree, symbols);
+            optimize(tree, symbols);
+            print_result(out, tree.evaluate(symbols.data()));
+        }
+    }
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+//The corpus as one buffer like a chunk of the pipelined mode through run_lines(): cache hits run their entry, the
+//misses are parsed in batches
+void end_to_end_bulk(benchmark::State& state, const Corpus& corpus) {
+    std::string text;
+    for (const std::string& line : corpus.lines)
+        text += line + '\n';
+    SymbolTable symbols = corpus_symbols(corpus);
+    NullBuffer buffer;
+    std::ostream out(&buffer);
+    ParsedLines lines;
+    PreparedCorpus prepared = prepare(corpus);
+    std::size_t before = allocations.load();
+    for (auto _ : state)
+        run_lines(text, symbols, out, lines);
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+//The whole corpus as one script, statements in parallel where the dependencies allow it
+void script(benchmark::State& state, const Corpus& corpus) {
+    std::string text;
+    for (const std::string& line : corpus.lines)
+        text += line + '\n';
+    NullBuffer buffer;
+    std::ostream out(&buffer);
+    PreparedCorpus prepared = prepare(corpus);
+    std::size_t before = allocations.load();
+    for (auto _ : state) {
+        SymbolTable symbols = corpus_symbols(corpus);
+        std::istringstream input(text);
+        ScriptRunner(symbols, unsigned(state.range(0))).run(input, out);
+    }
+    report(state, corpus.lines.size(), prepared.nodes, allocations.load() - before);
+}
+
+//Spreadsheet of 1000 formulas in 16 columns, every iteration changes the input of one column
+//update goes through ReactiveSheet, full re-evaluates every formula in order like the plain mode would have to
+std::vector<std::string> sheet_formulas() {
+    CorpusGenerator generator(16);
+    std::vector<std::string> formulas;
+    for (std::size_t i = 0; i < 1000; ++i)
+        formulas.push_back(generator.formula(i));
+    return formulas;
+}
+
+//Alternating values, so every update really changes its input
+std::string sheet_input(std::size_t iteration) {
+    return "v" + std::to_string(iteration % 16) + " = " + (iteration % 32 < 16 ? "2.5" : "1.5");
+}
+
+void reactive_update(benchmark::State& state) {
+    Corpus inputs{ "sheet", {}, 16 };
+    SymbolTable symbols = corpus_symbols(inputs);
+    ReactiveSheet sheet(symbols);
+    for (const std::string& formula : sheet_formulas())
+        sheet.update(formula);
+    std::size_t iteration = 0, recomputed = sheet.recomputed(), before = allocations.load();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(sheet.update(sheet_input(iteration++)));
+    std::size_t nodes = (sheet.recomputed() - recomputed) / std::max<std::size_t>(iteration, 1);
+    report(state, 1, nodes, allocations.load() - before);
+}
+
+void reactive_full(benchmark::State& state) {
+    Corpus inputs{ "sheet", {}, 16 };
+    SymbolTable symbols = corpus_symbols(inputs);
+    std::vector<CompiledExpression> programs;
+    std::size_t nodes = 0;
+    for (const std::string& formula : sheet_formulas()) {
+        SyntaxTree tree;
+        ParserSession::local().parse(formula, tree, symbols);
+        optimize(tree, symbols);
+        programs.push_back(compile(tree));
+        nodes += programs.back().instructions().size();
+    }
+    SyntaxTree input;
+    std::size_t iteration = 0, before = allocations.load();
+    for (auto _ : state) {
+        ParserSession::local().parse(sheet_input(iteration++), input, symbols);
+        input.evaluate(symbols.data());
+        for (const CompiledExpression& program : programs)
+            benchmark::DoNotOptimize(program.evaluate(symbols.data()));
+    }
+    report(state, 1, nodes, allocations.load() - before);
+}
+
+/******************************************************************************/
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    using Benchmark = void (*)(benchmark::State&, const Corpus&);
+    const std::pair<const char*, Benchmark> benchmarks[] = {
+        { "Parse", parse },
+        { "Parse/bulk", parse_bulk },
+        { "Evaluate/tree", evaluate_tree },
+        { "Evaluate/bytecode", evaluate_bytecode },
+        { "Evaluate/jit", evaluate_jit },
+        { "Evaluate/hot", evaluate_hot },
+        { "Evaluate/batch", evaluate_batch_short_circuit },
+        { "Evaluate/batch_branchless", evaluate_batch_branchless },
+        { "Evaluate/batch_approximate", evaluate_batch_approximate },
+        { "Evaluate/dag", evaluate_dag },
+        { "EndToEnd/cached", end_to_end },
+        { "EndToEnd/uncached", end_to_end_uncached },
+        { "EndToEnd/bulk", end_to_end_bulk },
+    };
+    for (const Corpus& corpus : corpora())
+        for (const auto& [name, function] : benchmarks)
+            benchmark::RegisterBenchmark((std::string(name) + "/" + corpus.name).c_str(), function, corpus);
+
+    for (const Corpus& corpus : corpora())
+        if (corpus.name == "assignment_script")
+            benchmark::RegisterBenchmark(("Script/" + corpus.name).c_str(), script, corpus)
+                ->Arg(1)->Arg(std::max(2u, std::thread::hardware_concurrency()))->UseRealTime();
+
+    benchmark::RegisterBenchmark("Reactive/update", reactive_update);
+    benchmark::RegisterBenchmark("Reactive/full", reactive_full);
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
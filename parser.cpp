@@ -2,234 +2,5241 @@
 //
 // The grammar accepts expressions like "y = 1 + 2 * x", constructs an AST and
 // evaluates it. Non-assignment expression are also evaluated.
+// The Spirit Qi grammar is built with -DSIMPLEPARSER_USE_QI, otherwise a hand-written parser of the same EBNF is used.
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <float.h>
 #include <math.h>
 
+#if !defined(_WIN32)
+#define SIMPLEPARSER_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(SIMPLEPARSER_EXPERIMENTAL_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifdef SIMPLEPARSER_USE_QI
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/phoenix.hpp>
 
 namespace qi = boost::spirit::qi;
 namespace phx = boost::phoenix;
+#endif
+
+#ifdef SIMPLEPARSER_SERVER
+#include <boost/asio.hpp>
+
+namespace asio = boost::asio;
+#endif
 
 /******************************************************************************/
 
+// Thrown by the parsers, keeps the part of the input the parser could not consume
+class ParseError : public std::runtime_error {
+public:
+    static constexpr const char* message = "Parse error";
+
+    explicit ParseError(std::string unparsed) : std::runtime_error(message), unparsed(std::move(unparsed)) { }
+
+    std::string unparsed;
+};
+
+// Caps on the memory one input can make the parsers use, set from the command line (--max-nodes, --max-nesting,
+// --max-variables) before any thread parses, a Worker sets them from every job before the threads of that job start.
+// Checked while parsing, so an input over a limit fails before it gets to allocate more
+//   max_nodes      Nodes in the tree of one input, including the ones left behind by backtracking
+//   max_nesting    nested groups in one input, they are the recursion of the parsers and so use the stack
+//   max_variables  names in one SymbolTable, so per thread, chunk or connection (a tenant of the server)
+struct Limits {
+    std::size_t max_nodes = std::size_t(1) << 24;
+    std::size_t max_nesting = 4096;
+    std::size_t max_variables = std::size_t(1) << 24;
+};
+
+inline Limits& limits() {
+    static Limits all;
+    return all;
+}
+
+//How parsing one input ended, for the parse functions that report instead of throwing
+enum class ParseStatus : std::uint8_t { Ok, Failed, TooManyNodes, TooDeep, TooManyVariables };
+
+//Error message of a status over one of the limits
+inline std::string limit_message(ParseStatus status) {
+    if (status == ParseStatus::TooManyNodes)
+        return "Expression has more than " + std::to_string(limits().max_nodes) + " Nodes";
+    if (status == ParseStatus::TooDeep)
+        return "Expression nests more than " + std::to_string(limits().max_nesting) + " groups";
+    return "More than " + std::to_string(limits().max_variables) + " variables";
+}
+
+// Thrown instead of ParseError for an input over one of the limits, whatever it would have parsed to
+class LimitExceeded : public std::runtime_error {
+public:
+    explicit LimitExceeded(ParseStatus status) : std::runtime_error(limit_message(status)), status(status) { }
+
+    ParseStatus status;
+};
+
+#ifdef SIMPLEPARSER_USE_QI
 // Utility to run a parser, check for errors, and capture the results.
-template<typename Parser, typename Skipper, typename ... Args>
-void PhraseParseOrDie(const std::string& input, const Parser& p, const Skipper& s, Args&& ... args) {
-    std::string::const_iterator begin = input.begin(), end = input.end();
-    boost::spirit::qi::phrase_parse(begin, end, p, s, std::forward<Args>(args) ...);
-    if (begin != end) {
-        std::cout << "Unparseable: " << std::quoted(std::string(begin, end)) << std::endl;
-        throw std::runtime_error("Parse error");
-    }
+// Works on any forward iterator range, f.e. std::string::const_iterator or const char* into a mapped file
+template<typename Iterator, typename Parser, typename Skipper, typename ... Args>
+void PhraseParseOrDie(Iterator begin, Iterator end, const Parser& p, const Skipper& s, Args&& ... args) {
+    bool ok = boost::spirit::qi::phrase_parse(begin, end, p, s, std::forward<Args>(args) ...);
+    //A failed parse (f.e. an empty line) leaves the output untouched, so it has to be treated like leftover input
+    if (!ok || begin != end)
+        throw ParseError(std::string(begin, end));
 }
+#endif
 
 /******************************************************************************/
 
-// the variable value map (Map x from equation to actual double value)
-std::map<std::string, double> variable_map;
+// Opt-in instrumentation of the hot path, built with -DSIMPLEPARSER_STATS (make STATS=1)
+// Records latency histograms per phase and a few counters, dumped as JSON to stderr at exit and on SIGUSR1
+// Without the flag the macros expand to the plain expression, so a normal build has no trace of it
+#ifdef SIMPLEPARSER_STATS
+#include <chrono>
+#include <csignal>
+#include <pthread.h>
+#include <sys/resource.h>
 
-//Abstract Interface for Node of Tree
-class ASTNode {
-public:
-    virtual double evaluate() = 0;
-    virtual ~ASTNode() { }
+namespace stats {
+
+enum Phase { CacheLookup, Parse, Optimize, Evaluate, Output, PhaseCount };
+
+constexpr const char* phase_names[PhaseCount] = { "cache_lookup", "parse", "optimize", "evaluate", "output" };
+
+// Power of two buckets of nanoseconds, bucket i counts latencies in [2^i, 2^(i+1))
+struct Histogram {
+    static constexpr std::size_t bucket_count = 40;
+
+    void record(std::uint64_t nanoseconds) {
+        std::size_t bucket = std::min<std::size_t>(63 - __builtin_clzll(nanoseconds | 1), bucket_count - 1);
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    std::atomic<std::uint64_t> count{ 0 }, total{ 0 };
+    std::atomic<std::uint64_t> buckets[bucket_count] = {};
 };
 
-using ASTNodePtr = ASTNode*;
+//All threads record into the same counters, relaxed as they are only read for the dump
+struct Counters {
+    Histogram phases[PhaseCount];
+    std::atomic<std::uint64_t> expressions{ 0 }, errors{ 0 }, nodes{ 0 }, allocations{ 0 };
+    std::atomic<std::uint64_t> cache_hits{ 0 }, cache_misses{ 0 };
+    //Inputs over one of the limits(), and the highest memory use of any single expression or session
+    std::atomic<std::uint64_t> limits_exceeded{ 0 };
+    std::atomic<std::uint64_t> peak_expression_nodes{ 0 }, peak_node_bytes{ 0 }, peak_cache_bytes{ 0 };
+    std::atomic<std::uint64_t> peak_symbol_bytes{ 0 };
+};
+
+inline Counters& counters() {
+    static Counters all;
+    return all;
+}
+
+//Raises peak to value if that is higher
+inline void raise(std::atomic<std::uint64_t>& peak, std::uint64_t value) {
+    std::uint64_t current = peak.load(std::memory_order_relaxed);
+    while (current < value && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+}
+
+//Runs f and records its duration under phase, returns what f returns
+template<typename Function>
+auto timed(Phase phase, Function&& f) -> decltype(f()) {
+    struct Record {
+        Phase phase;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ~Record() {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            counters().phases[phase].record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    } record{ phase };
+    return f();
+}
+
+void dump(std::FILE* out) {
+    Counters& all = counters();
+    auto load = [](const std::atomic<std::uint64_t>& value) { return static_cast<unsigned long long>(value.load()); };
+    unsigned long long hits = load(all.cache_hits), misses = load(all.cache_misses);
+
+    std::fprintf(out, "{\"expressions\": %llu, \"errors\": %llu, \"nodes\": %llu, \"allocations\": %llu, ",
+                 load(all.expressions), load(all.errors), load(all.nodes), load(all.allocations));
+    std::fprintf(out, "\"cache\": {\"hits\": %llu, \"misses\": %llu, \"hit_rate\": %.4f}, \"phases\": {",
+                 hits, misses, hits + misses ? double(hits) / double(hits + misses) : 0.0);
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        const Histogram& histogram = all.phases[phase];
+        unsigned long long count = load(histogram.count), total = load(histogram.total);
+        std::fprintf(out, "%s\"%s\": {\"count\": %llu, \"total_ns\": %llu, \"mean_ns\": %.1f, \"histogram_ns\": {",
+                     phase ? ", " : "", phase_names[phase], count, total, count ? double(total) / double(count) : 0.0);
+        // Only the used buckets, keyed by their lower bound
+        bool first = true;
+        for (std::size_t bucket = 0; bucket < Histogram::bucket_count; ++bucket) {
+            if (unsigned long long n = load(histogram.buckets[bucket])) {
+                std::fprintf(out, "%s\"%llu\": %llu", first ? "" : ", ", 1ull << bucket, n);
+                first = false;
+            }
+        }
+        std::fprintf(out, "}}");
+    }
+    // Peak resident set of the whole process, in KiB on Linux
+    struct rusage usage;
+    long max_rss = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+    std::fprintf(out, "}, \"memory\": {\"limits_exceeded\": %llu, \"peak_expression_nodes\": %llu, ",
+                 load(all.limits_exceeded), load(all.peak_expression_nodes));
+    std::fprintf(out, "\"peak_session_bytes\": {\"nodes\": %llu, \"cache\": %llu, \"symbols\": %llu}, ",
+                 load(all.peak_node_bytes), load(all.peak_cache_bytes), load(all.peak_symbol_bytes));
+    std::fprintf(out, "\"max_rss_kib\": %ld}}\n", max_rss);
+    std::fflush(out);
+}
+
+//Dumps at exit and on every SIGUSR1, call before any other thread is started
+//SIGUSR1 is blocked in all threads and taken by one waiting thread, so the dump does not run in a signal handler
+void install() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread([signals] {
+        for (int signal; sigwait(&signals, &signal) == 0;)
+            dump(stderr);
+    }).detach();
+    std::atexit([] { dump(stderr); });
+}
+
+}
+
+// Every allocation of the process is counted, out of line so GCC does not pair an inlined free() with new
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    stats::counters().allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+#define SIMPLEPARSER_TIMED(phase, ...) (stats::timed(stats::phase, [&]() -> decltype(auto) { return __VA_ARGS__; }))
+#define SIMPLEPARSER_COUNT(counter, n) (stats::counters().counter.fetch_add(n, std::memory_order_relaxed))
+#define SIMPLEPARSER_PEAK(counter, value) (stats::raise(stats::counters().counter, value))
+#else
+#define SIMPLEPARSER_TIMED(phase, ...) (__VA_ARGS__)
+#define SIMPLEPARSER_COUNT(counter, n) ((void)0)
+#define SIMPLEPARSER_PEAK(counter, value) ((void)0)
+#endif
 
-// Extend abstract Node Interface to specify handling of Operators
-template<char Operator>
-class OperatorNode : public ASTNode {
+/******************************************************************************/
+
+// Interns every variable name once to a dense slot, the values of all variables live in one contiguous array
+// Nodes and Programs only keep the slot, so evaluating never has to look up a string
+class SymbolTable {
 public:
-    //Each Operator has LHS and RHS -> Therefore children
-    OperatorNode(const ASTNodePtr& left, const ASTNodePtr& right) : left(left), right(right) { }
+    //Slot of identifier, new names get the next free slot with the value 0
+    //Throws LimitExceeded for a new name once the table holds limits().max_variables names
+    std::uint32_t resolve(const std::string& identifier) {
+        std::uint32_t slot;
+        if (!try_resolve(identifier, slot))
+            throw LimitExceeded(ParseStatus::TooManyVariables);
+        return slot;
+    }
+
+    //Same without exceptions, false if identifier would be a new name but the table is full
+    bool try_resolve(const std::string& identifier, std::uint32_t& slot) {
+        auto it = slots.find(identifier);
+        if (it == slots.end()) {
+            if (names.size() >= limits().max_variables)
+                return false;
+            it = slots.emplace(identifier, static_cast<std::uint32_t>(names.size())).first;
+            names.push_back(identifier);
+            values.push_back(0.0);
+            // Short names live inside the std::string, only longer ones take memory of their own (twice)
+            if (identifier.size() > std::string().capacity())
+                name_bytes += 2 * (identifier.size() + 1);
+        }
+        slot = it->second;
+        return true;
+    }
+
+    void set(const std::string& identifier, double value) {
+        values[resolve(identifier)] = value;
+    }
+
+    //Binding by slot, f.e. for evaluating one Program with different inputs
+    double& operator[](std::uint32_t slot) {
+        return values[slot];
+    }
+
+    double operator[](std::uint32_t slot) const {
+        return values[slot];
+    }
 
-    //recursive descent until last Node is actual Constant Number Value
-    double evaluate() {
-        if (Operator == '+')
-            return left->evaluate() + right->evaluate();
-        else if (Operator == '*')
-            return left->evaluate() * right->evaluate();
-        else if (Operator == '-')
-            return left->evaluate() - right->evaluate();
-        else if (Operator == '/')
-            return left->evaluate() / right->evaluate();
-        else if (Operator == '^')
-            return pow(left->evaluate(), right->evaluate());
-        else if (Operator == 'A')
-            return (bool(left->evaluate()) * bool(right->evaluate()));
-        else if (Operator == 'O')
-            return bool(bool(left->evaluate()) + bool(right->evaluate()));
+    //Only valid until the next new name gets resolved
+    double* data() {
+        return values.data();
     }
 
-    ~OperatorNode() {
-        delete left;
-        delete right;
+    //Constant variables (f.e. pi) get replaced by their current value when a tree is optimized
+    //So they must not change anymore while optimized trees or Programs of them are still in use
+    void mark_constant(const std::string& identifier) {
+        set_constant(resolve(identifier), true);
+    }
+
+    void set_constant(std::uint32_t slot, bool constant) {
+        if (constants.size() <= slot)
+            constants.resize(slot + 1, false);
+        constants[slot] = constant;
+    }
+
+    bool is_constant(std::uint32_t slot) const {
+        return slot < constants.size() && constants[slot];
+    }
+
+    const std::string& name(std::uint32_t slot) const {
+        return names[slot];
+    }
+
+    std::size_t size() const {
+        return names.size();
+    }
+
+    //Memory held by the names, values and the index of the table, estimated from their sizes
+    std::size_t bytes() const {
+        // Every name is in the index (a hash node with the key, slot and pointers) and in names
+        std::size_t entry = 2 * sizeof(std::string) + sizeof(std::uint32_t) + 2 * sizeof(void*);
+        return names.size() * entry + name_bytes + values.capacity() * sizeof(double) +
+               slots.bucket_count() * sizeof(void*) + constants.capacity() / 8;
     }
 
 private:
-    ASTNodePtr left, right;
+    std::unordered_map<std::string, std::uint32_t> slots;
+    std::vector<std::string> names;
+    std::vector<double> values;
+    std::vector<bool> constants;
+    //Heap memory of the names too long to be stored in place
+    std::size_t name_bytes = 0;
 };
 
-// Extend abstract Node Interface to specify handling of Numbers
-class ConstantNode : public ASTNode {
+// Variables shared by all threads, published as whole immutable SymbolTables (copy on write)
+// Readers get the current version with one atomic load and never lock, a writer copies the current version, changes the
+// copy and publishes it. Old versions stay alive as long as the Environment, a reader might still be using them; so
+// modify() is meant for rare changes like defining shared constants, not for every assignment
+class Environment {
 public:
-    //Does not need Children as it is just numbers
-    ConstantNode(double value) : value(value) { }
+    Environment() : Environment(SymbolTable()) { }
+
+    explicit Environment(SymbolTable initial) {
+        versions.push_back(std::make_unique<const SymbolTable>(std::move(initial)));
+        current.store(versions.back().get(), std::memory_order_release);
+    }
+
+    Environment(const Environment&) = delete;
+    Environment& operator=(const Environment&) = delete;
+
+    //Latest published version, valid as long as the Environment
+    const SymbolTable& snapshot() const {
+        return *current.load(std::memory_order_acquire);
+    }
+
+    //Number of versions published after the initial one
+    std::size_t version() const {
+        return published.load(std::memory_order_acquire);
+    }
 
-    double evaluate() {
-        return value;
+    //update gets a copy of the latest version, which replaces it for all readers from then on
+    //Writers are serialized, readers that already hold the previous version keep seeing it unchanged
+    template<typename Update>
+    void modify(Update&& update) {
+        std::lock_guard<std::mutex> lock(writers);
+        auto next = std::make_unique<SymbolTable>(snapshot());
+        update(*next);
+        versions.push_back(std::move(next));
+        current.store(versions.back().get(), std::memory_order_release);
+        published.fetch_add(1, std::memory_order_release);
     }
 
+    // Private variables of one thread: a copy of a snapshot that assignments can change without affecting anyone
+    // reset() starts over from the latest version, the copy reuses the memory of the previous one
+    class Context {
+    public:
+        explicit Context(const Environment& environment) : environment(environment), table(environment.snapshot()) { }
+
+        SymbolTable& reset() {
+            table = environment.snapshot();
+            return table;
+        }
+
+        SymbolTable& symbols() {
+            return table;
+        }
+
+    private:
+        const Environment& environment;
+        SymbolTable table;
+    };
+
 private:
-    double value;
+    std::mutex writers;
+    std::vector<std::unique_ptr<const SymbolTable>> versions;
+    std::atomic<const SymbolTable*> current{ nullptr };
+    std::atomic<std::size_t> published{ 0 };
 };
 
-// Extend abstract Node Interface to specify handling of Variables
-class VariableNode : public ASTNode {
+/******************************************************************************/
+
+// Instructions of the postfix program a tree gets compiled to, the Nodes of a SyntaxTree use the same OpCodes
+enum class OpCode : std::uint8_t {
+    PushConstant, PushVariable,
+    Add, Subtract, Multiply, Divide, Power, And, Or,
+    //Only in Programs: skip the right operand of an And / Or whose left operand already decides it
+    JumpIfFalse, JumpIfTrue,
+    Assign, AssignAdd, AssignSubtract, AssignMultiply, AssignDivide
+};
+
+//Constant is used by PushConstant, variable is the SymbolTable slot of PushVariable and the Assignments
+//and for the Jumps the number of Instructions they skip (up to and including their And / Or)
+struct Instruction {
+    OpCode op;
+    std::uint32_t variable;
+    double constant;
+};
+
+//Left operand of an And / Or (or the value a Jump tests) that decides the result alone: false for And, true for Or
+//Operands have no side effects, so the right one does not need to be evaluated then
+inline bool decides(OpCode op, double lhs) {
+    return op == OpCode::And || op == OpCode::JumpIfFalse ? !bool(lhs) : bool(lhs);
+}
+
+//Result of an And / Or decided by its left operand
+inline double decided_value(OpCode op) {
+    return op == OpCode::And || op == OpCode::JumpIfFalse ? 0.0 : 1.0;
+}
+
+// Instructions of a Program, contiguous no matter if the Program owns them or only refers to them
+class InstructionRange {
 public:
-    //Stores "Name" of variable
-    VariableNode(std::string identifier) : identifier(identifier) { }
+    InstructionRange(const Instruction* first, const Instruction* last) : first(first), last(last) { }
+
+    const Instruction* begin() const {
+        return first;
+    }
+
+    const Instruction* end() const {
+        return last;
+    }
+
+    std::size_t size() const {
+        return std::size_t(last - first);
+    }
 
-    //Returns Maped value of Variable
-    double evaluate() {
-        return variable_map[identifier];
+    bool empty() const {
+        return first == last;
+    }
+
+    const Instruction& back() const {
+        return last[-1];
+    }
+
+    const Instruction& operator[](std::size_t index) const {
+        return first[index];
     }
 
 private:
-    std::string identifier;
+    const Instruction* first;
+    const Instruction* last;
 };
 
-// Extend abstract Node Interface to specify handling of Equationsymbol
-template<char Operator>
-class AssignmentNode : public ASTNode {
+// Flat postfix version of a tree, independent of the SyntaxTree it was compiled from
+// Can be stored and run any number of times by a simple stack machine instead of walking the tree
+// Variables are slots of the SymbolTable that was used for parsing, their values are passed to evaluate()
+class CompiledExpression {
 public:
-    //Allowing "Ans" by also storing current Value in identifier, but effectivly only needs to evaluate whole tree as it is Top Node
-    AssignmentNode(std::string identifier, const ASTNodePtr& value) : identifier(identifier), value(value) { }
+    CompiledExpression() = default;
+
+    //Program running count Instructions at code in place, f.e. inside a mapped CompiledLibrary
+    //code has to outlive the Program and its copies, nothing can be appended to it
+    static CompiledExpression view(const Instruction* code, std::size_t count, std::size_t stack_size) {
+        CompiledExpression program;
+        program.external = code;
+        program.external_size = count;
+        program.max_depth = stack_size;
+        return program;
+    }
+
+    //Appending Instructions keeps track of the stack depth, so evaluate() knows the size upfront
+    void push_constant(double value) {
+        code.push_back({ OpCode::PushConstant, 0, value });
+        grow_stack(1);
+    }
 
-    double evaluate() {
-        if(Operator == '=') {
-            double v = value->evaluate();
-            variable_map[identifier] = v;
-            return v;
-        } else if(Operator == '+') {
-            double v = value->evaluate();
-            variable_map[identifier] += v;
-            return variable_map[identifier];
-        } else if(Operator == '-') {
-            double v = value->evaluate();
-            variable_map[identifier] -= v;
-            return variable_map[identifier];
-        } else if(Operator == '*') {
-            double v = value->evaluate();
-            variable_map[identifier] *= v;
-            return variable_map[identifier];
-        } else if(Operator == '/') {
-            double v = value->evaluate();
-            variable_map[identifier] /= v;
-            return variable_map[identifier];
+    void push_variable(std::uint32_t slot) {
+        code.push_back({ OpCode::PushVariable, slot, 0.0 });
+        grow_stack(1);
+    }
+
+    //Binary Operators replace the two topmost values by their result
+    void push_operator(OpCode op) {
+        code.push_back({ op, 0, 0.0 });
+        --depth;
+    }
+
+    //Assignments replace the topmost value by the new value of the variable
+    void push_assignment(OpCode op, std::uint32_t slot) {
+        code.push_back({ op, slot, 0.0 });
+    }
+
+    //Jump in front of the right operand of an And (JumpIfFalse) / Or (JumpIfTrue), returns it for land_jump()
+    //If the topmost value decides the result, it gets replaced by the result and the operand is skipped
+    std::size_t push_jump(OpCode op) {
+        code.push_back({ op, 0, 0.0 });
+        return code.size() - 1;
+    }
+
+    //Lets jump skip everything appended after it, called right after its And / Or was appended
+    void land_jump(std::size_t jump) {
+        code[jump].variable = static_cast<std::uint32_t>(code.size() - 1 - jump);
+    }
+
+    //Empties the Program but keeps its memory, f.e. to compile many trees one after another
+    void clear() {
+        code.clear();
+        external = nullptr;
+        external_size = 0;
+        depth = max_depth = 0;
+    }
+
+    //variables is indexed by slot, f.e. SymbolTable::data()
+    double evaluate(double* variables) const {
+        // Only a cleared Program is empty, every compiled tree leaves its value on the stack
+        InstructionRange range = instructions();
+        if (range.empty())
+            return 0.0;
+
+        // Small programs run on a stack array, only very deep ones need the heap
+        double local_stack[32];
+        std::unique_ptr<double[]> heap_stack;
+        double* stack = local_stack;
+        if (max_depth > 32) {
+            heap_stack.reset(new double[max_depth]);
+            stack = heap_stack.get();
+        }
+
+        std::size_t top = 0;
+        for (const Instruction* next = range.begin(); next != range.end(); ++next) {
+            const Instruction& instruction = *next;
+            switch (instruction.op) {
+                case OpCode::PushConstant: stack[top++] = instruction.constant; break;
+                case OpCode::PushVariable: stack[top++] = variables[instruction.variable]; break;
+                case OpCode::Add: --top; stack[top - 1] = stack[top - 1] + stack[top]; break;
+                case OpCode::Subtract: --top; stack[top - 1] = stack[top - 1] - stack[top]; break;
+                case OpCode::Multiply: --top; stack[top - 1] = stack[top - 1] * stack[top]; break;
+                case OpCode::Divide: --top; stack[top - 1] = stack[top - 1] / stack[top]; break;
+                case OpCode::Power: --top; stack[top - 1] = pow(stack[top - 1], stack[top]); break;
+                case OpCode::And: --top; stack[top - 1] = bool(stack[top - 1]) * bool(stack[top]); break;
+                case OpCode::Or: --top; stack[top - 1] = bool(bool(stack[top - 1]) + bool(stack[top])); break;
+                case OpCode::JumpIfFalse:
+                case OpCode::JumpIfTrue:
+                    if (decides(instruction.op, stack[top - 1])) {
+                        stack[top - 1] = decided_value(instruction.op);
+                        next += instruction.variable;
+                    }
+                    break;
+                default: {
+                    double& variable = variables[instruction.variable];
+                    if (instruction.op == OpCode::Assign)
+                        variable = stack[top - 1];
+                    else if (instruction.op == OpCode::AssignAdd)
+                        variable += stack[top - 1];
+                    else if (instruction.op == OpCode::AssignSubtract)
+                        variable -= stack[top - 1];
+                    else if (instruction.op == OpCode::AssignMultiply)
+                        variable *= stack[top - 1];
+                    else
+                        variable /= stack[top - 1];
+                    stack[top - 1] = variable;
+                }
+            }
         }
+        return stack[0];
+    }
+
+    InstructionRange instructions() const {
+        if (external)
+            return InstructionRange(external, external + external_size);
+        return InstructionRange(code.data(), code.data() + code.size());
+    }
+
+    //Number of values evaluate() needs on its stack at most
+    std::size_t stack_size() const {
+        return max_depth;
     }
 
 private:
-    std::string identifier;
-    ASTNodePtr value;
+    void grow_stack(std::size_t count) {
+        depth += count;
+        max_depth = std::max(max_depth, depth);
+    }
+
+    std::vector<Instruction> code;
+    //Instructions of a view(), used instead of code
+    const Instruction* external = nullptr;
+    std::size_t external_size = 0;
+    std::size_t depth = 0, max_depth = 0;
 };
 
 /******************************************************************************/
-// EBNF of this Grammar:
-//      varname = "A" .. "z" , { <alphanumeric> }
-//      start = (varname, ("=" | "+=" | "-=" | "*=" | "/=") , term) | term
-//      term = product, ("+" | "-"), term | product
-//      product = (factor, ("*" | "/" | "^" | "&&" | "||") , product) | (factor)
-//      factor = group | varname | double-number
-//      group = "(", term, ")"
 
+//Position of a Node inside its SyntaxTree
+using NodeIndex = std::uint32_t;
+
+// One Node of a SyntaxTree: 16 bytes, no vtable and no pointers, so a whole tree can be copied with one memcpy
+// op reuses the OpCodes of the bytecode, PushConstant and PushVariable are the leaves, Operators have two operands
+// and Assignments one, operands are indices into the same tree
+struct Node {
+    OpCode op;
+    //SymbolTable slot of Variables and Assignments
+    std::uint32_t slot;
+    union {
+        double constant;
+        NodeIndex operands[2];
+    };
+};
+
+static_assert(sizeof(Node) == 16, "Nodes are meant to fill exactly 16 bytes");
+static_assert(std::is_trivially_copyable<Node>::value, "Trees are copied as raw memory");
+
+//Binary Operators, shared by the tree walk and constant folding
+inline double apply_operator(OpCode op, double lhs, double rhs) {
+    switch (op) {
+        case OpCode::Add: return lhs + rhs;
+        case OpCode::Subtract: return lhs - rhs;
+        case OpCode::Multiply: return lhs * rhs;
+        case OpCode::Divide: return lhs / rhs;
+        case OpCode::Power: return pow(lhs, rhs);
+        case OpCode::And: return bool(lhs) * bool(rhs);
+        default: return bool(bool(lhs) + bool(rhs));
+    }
+}
+
+//Updates variable by an Assignment and returns its new value
+inline double apply_assignment(OpCode op, double& variable, double value) {
+    if (op == OpCode::Assign)
+        variable = value;
+    else if (op == OpCode::AssignAdd)
+        variable += value;
+    else if (op == OpCode::AssignSubtract)
+        variable -= value;
+    else if (op == OpCode::AssignMultiply)
+        variable *= value;
+    else
+        variable /= value;
+    return variable;
+}
+
+inline bool is_assignment(OpCode op) {
+    return op >= OpCode::Assign;
+}
 
-//Acutall Grammar 
-class ArithmeticGrammar : public qi::grammar<std::string::const_iterator, ASTNodePtr(), qi::space_type> {
+// Explicit stack of the tree walks, so the depth of a tree is only limited by memory and not by the call stack
+// The first Inline entries live inside the object (on the call stack of the walk), deeper walks continue on the heap
+template<typename T, std::size_t Inline = 64>
+class WalkStack {
 public:
-    using Iterator = std::string::const_iterator;
+    static_assert(std::is_trivially_copyable<T>::value, "Entries are copied as raw memory when the stack grows");
 
-    ArithmeticGrammar() : ArithmeticGrammar::base_type(start) {
-        //Say that varname equals alpha(character a-Z) or arbitrary number of alum(alphanumeric) i.E. it is possible to say var=42 and then use var
-        // %= is the most of the time equivalent of =, but needs to be %= this case as varname needs to be evaluated Later
-        varname %= qi::alpha >> *qi::alnum;
+    void push(const T& value) {
+        if (count == capacity)
+            grow();
+        entries[count++] = value;
+    }
 
-        // _val is set through lambdas -> Placeholder for actual value later
+    T pop() {
+        return entries[--count];
+    }
 
-        // Start either has to be either varname (f.e. 'y=') and then Term or just Term;
-        // Also Assignment Operations are allowed like +=, -=, *= and /= 
-        start = (varname >> '=' >> term)[qi::_val = phx::new_<AssignmentNode<'='>>(qi::_1, qi::_2)] | 
-                (varname >> qi::lit("+=") >> term)[qi::_val = phx::new_<AssignmentNode<'+'>>(qi::_1, qi::_2)] |
-                (varname >> qi::lit("-=") >> term)[qi::_val = phx::new_<AssignmentNode<'-'>>(qi::_1, qi::_2)] |
-                (varname >> qi::lit("*=") >> term)[qi::_val = phx::new_<AssignmentNode<'*'>>(qi::_1, qi::_2)] |
-                (varname >> qi::lit("/=") >> term)[qi::_val = phx::new_<AssignmentNode<'/'>>(qi::_1, qi::_2)] |
-                term[qi::_val = qi::_1];
+    bool empty() const {
+        return count == 0;
+    }
+
+private:
+    // Out of line, so push() stays small enough to be inlined into the walks
+    __attribute__((noinline)) void grow() {
+        std::unique_ptr<T[]> larger(new T[capacity * 2]);
+        std::copy(entries, entries + count, larger.get());
+        heap = std::move(larger);
+        entries = heap.get();
+        capacity *= 2;
+    }
 
-        // Term either has to be a Product +/- a Term or it can be just a Product
-        term = (product >> '+' >> term)[qi::_val = phx::new_<OperatorNode<'+'> >(qi::_1, qi::_2)] |
-            (product >> '-' >> term)[qi::_val = phx::new_<OperatorNode<'-'> >(qi::_1, qi::_2)] |
-            product[qi::_val = qi::_1];
+    T local[Inline];
+    std::unique_ptr<T[]> heap;
+    T* entries = local;
+    std::size_t count = 0, capacity = Inline;
+};
 
-        // Product can be a factor times a product or just a factor
-        product = (factor >> '*' >> product)[qi::_val = phx::new_<OperatorNode<'*'> >(qi::_1, qi::_2)] |
-            (factor >> '/' >> product)[qi::_val = phx::new_<OperatorNode<'/'> >(qi::_1, qi::_2)] |
-            (factor >> '^' >> product)[qi::_val = phx::new_<OperatorNode<'^'> >(qi::_1, qi::_2)] |
-            (factor >> qi::lit("&&") >> product)[qi::_val = phx::new_<OperatorNode<'A'>>(qi::_1, qi::_2)] |
-            (factor >> qi::lit("||") >> product)[qi::_val = phx::new_<OperatorNode<'O'>>(qi::_1, qi::_2)] |
-            factor[qi::_val = qi::_1];
+// Parsed expression as a flat pool of Nodes: one allocation per tree instead of one per Node, and reusing a tree after
+// clear() allocates nothing at all. The parser appends operands before the Node using them, so the root comes last
+class SyntaxTree {
+public:
+    SyntaxTree() = default;
 
-        // Factor can be a group, a varname or just a regular int
-        factor = group[qi::_val = qi::_1] | 
-            varname[qi::_val = phx::new_<VariableNode>(qi::_1)] | 
-            qi::double_[qi::_val = phx::new_<ConstantNode>(qi::_1)];
+    //Rebuilds a tree from raw Nodes, f.e. the data() of another tree
+    SyntaxTree(const Node* first, std::size_t count, NodeIndex root) : nodes(first, first + count), root_index(root) { }
 
-        //Group is just Brackets with Term in Middle -> Needs to be evaluated later, Therefore has %=
-        group %= '(' >> term >> ')';
+    NodeIndex constant(double value) {
+        Node node{};
+        node.op = OpCode::PushConstant;
+        node.constant = value;
+        return append(node);
     }
 
-    //Uses Iterator to go over parsed string, store output in string and as a skipper the qi::space_type is expected
-    qi::rule<Iterator, std::string(), qi::space_type> varname;
-    //Same but stores in ASTNote Pointer
-    qi::rule<Iterator, ASTNodePtr(), qi::space_type> start, term, group, product, factor;
+    NodeIndex variable(std::uint32_t slot) {
+        Node node{};
+        node.op = OpCode::PushVariable;
+        node.slot = slot;
+        return append(node);
+    }
+
+    NodeIndex binary(OpCode op, NodeIndex left, NodeIndex right) {
+        Node node{};
+        node.op = op;
+        node.operands[0] = left;
+        node.operands[1] = right;
+        return append(node);
+    }
+
+    NodeIndex assignment(OpCode op, std::uint32_t slot, NodeIndex value) {
+        Node node{};
+        node.op = op;
+        node.slot = slot;
+        node.operands[0] = value;
+        return append(node);
+    }
+
+    //variables holds the values by SymbolTable slot
+    double evaluate(double* variables) const {
+        return evaluate(root_index, variables);
+    }
+
+    //Walks the subtree at index without recursion, one switch per Node instead of a virtual call
+    //Inner Nodes are visited twice: first their inner operands get scheduled (left one on top), then the values are
+    //combined. Leaves never get a visit of their own, they are read right when their parent is combined
+    //And / Or get a visit in between, after the left operand: the right one is only scheduled if that does not decide
+    //(only for an inner right operand, reading a leaf costs less than the extra visit)
+    double evaluate(NodeIndex index, double* variables) const {
+        double value;
+        if (leaf_value(nodes[index], variables, value))
+            return value;
+
+        WalkStack<Visit> pending;
+        WalkStack<double> values;
+        pending.push({ index, Visit::Operands });
+        while (!pending.empty()) {
+            Visit visit = pending.pop();
+            const Node& node = nodes[visit.node];
+            const Node& left = nodes[node.operands[0]];
+            if (visit.step == Visit::Operands) {
+                if (is_assignment(node.op) || is_leaf(nodes[node.operands[1]])) {
+                    pending.push({ visit.node, Visit::Combine });
+                } else if (node.op == OpCode::And || node.op == OpCode::Or) {
+                    pending.push({ visit.node, Visit::Right });
+                } else {
+                    pending.push({ visit.node, Visit::Combine });
+                    pending.push({ node.operands[1], Visit::Operands });
+                }
+                if (!is_leaf(left))
+                    pending.push({ node.operands[0], Visit::Operands });
+                continue;
+            }
+
+            double lhs, rhs;
+            if (visit.step == Visit::Combine) {
+                if (is_assignment(node.op)) {
+                    if (!leaf_value(left, variables, rhs))
+                        rhs = values.pop();
+                    values.push(apply_assignment(node.op, variables[node.slot], rhs));
+                    continue;
+                }
+                // The right operand was scheduled last, so its value is on top
+                if (!leaf_value(nodes[node.operands[1]], variables, rhs))
+                    rhs = values.pop();
+                if (!leaf_value(left, variables, lhs))
+                    lhs = values.pop();
+                values.push(apply_operator(node.op, lhs, rhs));
+                continue;
+            }
+
+            bool inner = !leaf_value(left, variables, lhs);
+            if (inner)
+                lhs = values.pop();
+            if (decides(node.op, lhs)) {
+                values.push(decided_value(node.op));
+                continue;
+            }
+            // Combined like every other Operator, an inner left operand goes back below the right one
+            if (inner)
+                values.push(lhs);
+            pending.push({ visit.node, Visit::Combine });
+            pending.push({ node.operands[1], Visit::Operands });
+        }
+        return values.pop();
+    }
+
+    Node& operator[](NodeIndex index) {
+        return nodes[index];
+    }
+
+    const Node& operator[](NodeIndex index) const {
+        return nodes[index];
+    }
+
+    NodeIndex root() const {
+        return root_index;
+    }
+
+    void set_root(NodeIndex index) {
+        root_index = index;
+    }
+
+    bool empty() const {
+        return nodes.empty();
+    }
+
+    std::size_t size() const {
+        return nodes.size();
+    }
+
+    const Node* data() const {
+        return nodes.data();
+    }
+
+    //Memory of the pool, it keeps the size of the largest tree it ever held
+    std::size_t bytes() const {
+        return nodes.capacity() * sizeof(Node);
+    }
+
+    //Drops every Node at once, the memory is reused by the next parse
+    void clear() {
+        nodes.clear();
+        root_index = 0;
+    }
+
+private:
+    struct Visit {
+        enum Step : std::uint8_t { Operands, Right, Combine };
+
+        NodeIndex node;
+        Step step;
+    };
+
+    static bool is_leaf(const Node& node) {
+        return node.op == OpCode::PushConstant || node.op == OpCode::PushVariable;
+    }
+
+    static bool leaf_value(const Node& node, const double* variables, double& value) {
+        if (node.op == OpCode::PushConstant)
+            value = node.constant;
+        else if (node.op == OpCode::PushVariable)
+            value = variables[node.slot];
+        else
+            return false;
+        return true;
+    }
+
+    NodeIndex append(const Node& node) {
+        nodes.push_back(node);
+        return static_cast<NodeIndex>(nodes.size() - 1);
+    }
+
+    std::vector<Node> nodes;
+    NodeIndex root_index = 0;
 };
 
-void testGrammar(std::string input) {
-    try {
-        ASTNode* out_node;
-        // Pass input, Parser, skipper (space) and output-Node
-        PhraseParseOrDie(input, ArithmeticGrammar(), qi::space, out_node);
+// Everything needed to build a Node: the tree to append to and the SymbolTable varnames get resolved in
+struct NodeBuilder {
+    SyntaxTree* tree = nullptr;
+    SymbolTable* symbols = nullptr;
 
-        std::cout << "evaluate() = " << out_node->evaluate() << std::endl;
-        delete out_node;
+    //std::string attributes (the varnames) are turned into their slot, everything else is passed on as is
+    std::uint32_t argument(const std::string& identifier) const { return symbols->resolve(identifier); }
+    template<typename T>
+    const T& argument(const T& value) const { return value; }
+
+    //The OpCode decides the kind of Node: leaves, Assignments (slot, value) or Operators (left, right)
+    //Throws LimitExceeded once the tree holds limits().max_nodes Nodes
+    template<OpCode Op, typename ... Args>
+    NodeIndex create(const Args& ... args) const {
+        if (tree->size() >= limits().max_nodes)
+            throw LimitExceeded(ParseStatus::TooManyNodes);
+        if constexpr (Op == OpCode::PushConstant)
+            return tree->constant(argument(args) ...);
+        else if constexpr (Op == OpCode::PushVariable)
+            return tree->variable(argument(args) ...);
+        else if constexpr (Op >= OpCode::Assign)
+            return tree->assignment(Op, argument(args) ...);
+        else
+            return tree->binary(Op, argument(args) ...);
     }
-    catch (std::exception& e) {
-        std::cout << "EXCEPTION was THROWN: " << e.what() << std::endl;
+};
+
+//True if node is a constant holding exactly value (same sign for zeros)
+inline bool is_constant(const Node& node, double value) {
+    return node.op == OpCode::PushConstant && node.constant == value && std::signbit(node.constant) == std::signbit(value);
+}
+
+inline NodeIndex make_constant(SyntaxTree& tree, NodeIndex index, double value) {
+    tree[index].op = OpCode::PushConstant;
+    tree[index].constant = value;
+    return index;
+}
+
+//Simplifies the Node at index, whose operands are already simplified, and returns the index replacing it (possibly itself)
+//Folds constant operands and applies the identities that hold for every IEEE value (incl. NaN, inf and -0)
+//"x + 0" is kept, as -0 + 0 is +0, only "x + -0" and "x - 0" are identities
+//Nodes are rewritten in place, so the tree never grows; dropped operands just stay unreferenced
+NodeIndex simplify(SyntaxTree& tree, NodeIndex index, SymbolTable& symbols) {
+    OpCode op = tree[index].op;
+    if (op == OpCode::PushConstant)
+        return index;
+    //Variables marked as constant are substituted by their current value
+    if (op == OpCode::PushVariable) {
+        if (symbols.is_constant(tree[index].slot))
+            return make_constant(tree, index, symbols[tree[index].slot]);
+        return index;
+    }
+    if (is_assignment(op))
+        return index;
+
+    NodeIndex left = tree[index].operands[0];
+    NodeIndex right = tree[index].operands[1];
+    const Node& lhs = tree[left];
+    const Node& rhs = tree[right];
+    bool left_constant = lhs.op == OpCode::PushConstant, right_constant = rhs.op == OpCode::PushConstant;
+
+    if (left_constant && right_constant)
+        return make_constant(tree, index, apply_operator(op, lhs.constant, rhs.constant));
+
+    if (op == OpCode::Add) {
+        if (is_constant(rhs, -0.0))
+            return left;
+        if (is_constant(lhs, -0.0))
+            return right;
+    } else if (op == OpCode::Subtract) {
+        if (is_constant(rhs, 0.0))
+            return left;
+    } else if (op == OpCode::Multiply) {
+        if (is_constant(rhs, 1.0))
+            return left;
+        if (is_constant(lhs, 1.0))
+            return right;
+    } else if (op == OpCode::Divide) {
+        if (is_constant(rhs, 1.0))
+            return left;
+    } else if (op == OpCode::Power) {
+        if (is_constant(rhs, 1.0))
+            return left;
+        if (is_constant(rhs, 0.0) || is_constant(rhs, -0.0))
+            return make_constant(tree, index, 1.0);
+    } else if (op == OpCode::And) {
+        // Operands have no side effects, so one false side decides
+        if ((left_constant && !bool(lhs.constant)) || (right_constant && !bool(rhs.constant)))
+            return make_constant(tree, index, 0.0);
+    } else if (op == OpCode::Or) {
+        if ((left_constant && bool(lhs.constant)) || (right_constant && bool(rhs.constant)))
+            return make_constant(tree, index, 1.0);
     }
+    return index;
+}
+
+//Optimization pass between parsing and evaluation / compilation
+//Post-order walk without recursion: a Node is simplified after its operands and its replacement is written into the
+//operand of its parent (the tree does not grow, so pointers to operands stay valid)
+void optimize(SyntaxTree& tree, SymbolTable& symbols) {
+    struct Visit {
+        NodeIndex node;
+        NodeIndex* replaced_by;
+        bool operands_done;
+    };
+
+    NodeIndex root = tree.root();
+    WalkStack<Visit> pending;
+    pending.push({ root, &root, false });
+    while (!pending.empty()) {
+        Visit visit = pending.pop();
+        Node& node = tree[visit.node];
+        bool leaf = node.op == OpCode::PushConstant || node.op == OpCode::PushVariable;
+        if (!leaf && !visit.operands_done) {
+            pending.push({ visit.node, visit.replaced_by, true });
+            if (!is_assignment(node.op))
+                pending.push({ node.operands[1], &node.operands[1], false });
+            pending.push({ node.operands[0], &node.operands[0], false });
+            continue;
+        }
+        *visit.replaced_by = simplify(tree, visit.node, symbols);
+    }
+    tree.set_root(root);
+}
+
+//Turns a parsed tree into a stand-alone program, the tree can be cleared afterwards
+//Postfix order is operands first, then the Node itself, produced by the same kind of two visit walk as evaluate()
+//And / Or get a Jump between their operands, placed by a visit in between that remembers it until the Node is done
+//A leaf as right operand is cheaper to push than to jump over, those stay branchless
+//program has to be empty (new or cleared), compiling into the same one again and again reuses its memory
+void compile(const SyntaxTree& tree, CompiledExpression& program) {
+    enum Step : std::uint8_t { Operands, Right, Combine };
+    struct Visit {
+        NodeIndex node;
+        Step step;
+        std::uint32_t jump;
+    };
+
+    WalkStack<Visit> pending;
+    pending.push({ tree.root(), Operands, 0 });
+    while (!pending.empty()) {
+        Visit visit = pending.pop();
+        const Node& node = tree[visit.node];
+        bool short_circuit = (node.op == OpCode::And || node.op == OpCode::Or) &&
+                             tree[node.operands[1]].op != OpCode::PushConstant &&
+                             tree[node.operands[1]].op != OpCode::PushVariable;
+        if (node.op == OpCode::PushConstant) {
+            program.push_constant(node.constant);
+        } else if (node.op == OpCode::PushVariable) {
+            program.push_variable(node.slot);
+        } else if (visit.step == Operands) {
+            pending.push({ visit.node, short_circuit ? Right : Combine, 0 });
+            if (!is_assignment(node.op) && !short_circuit)
+                pending.push({ node.operands[1], Operands, 0 });
+            pending.push({ node.operands[0], Operands, 0 });
+        } else if (visit.step == Right) {
+            OpCode jump = node.op == OpCode::And ? OpCode::JumpIfFalse : OpCode::JumpIfTrue;
+            pending.push({ visit.node, Combine, std::uint32_t(program.push_jump(jump)) });
+            pending.push({ node.operands[1], Operands, 0 });
+        } else if (is_assignment(node.op)) {
+            program.push_assignment(node.op, node.slot);
+        } else {
+            program.push_operator(node.op);
+            if (short_circuit)
+                program.land_jump(visit.jump);
+        }
+    }
+}
+
+CompiledExpression compile(const SyntaxTree& tree) {
+    CompiledExpression program;
+    compile(tree, program);
+    return program;
 }
 
 /******************************************************************************/
 
-int main() {
-    // important variables
-    variable_map["x"] = 42;
-    variable_map["pi"] = 3.14159265359;
+// Kernels of the column wise evaluation, each runs one Operator over a whole block of rows
+// Plain loops over separate arrays without branches, so the compiler can auto-vectorize them
+namespace batch {
+
+inline void add(double* __restrict lhs, const double* __restrict rhs, std::size_t rows) {
+    for (std::size_t i = 0; i < rows; ++i)
+        lhs[i] = lhs[i] + rhs[i];
+}
+
+inline void subtract(double* __restrict lhs, const double* __restrict rhs, std::size_t rows) {
+    for (std::size_t i = 0; i < rows; ++i)
+        lhs[i] = lhs[i] - rhs[i];
+}
+
+inline void multiply(double* __restrict lhs, const double* __restrict rhs, std::size_t rows) {
+    for (std::size_t i = 0; i < rows; ++i)
+        lhs[i] = lhs[i] * rhs[i];
+}
+
+inline void divide(double* __restrict lhs, const double* __restrict rhs, std::size_t rows) {
+    for (std::size_t i = 0; i < rows; ++i)
+        lhs[i] = lhs[i] / rhs[i];
+}
+
+inline void power(double* __restrict lhs, const double* __restrict rhs, std::size_t rows) {
+    for (std::size_t i = 0; i < rows; ++i)
+        lhs[i] = pow(lhs[i], rhs[i]);
+}
+
+inline void logical_and(double* __restrict lhs, const double* __restrict rhs, std::size_t rows) {
+    for (std::size_t i = 0; i < rows; ++i)
+        lhs[i] = (lhs[i] != 0.0) & (rhs[i] != 0.0) ? 1.0 : 0.0;
+}
+
+inline void logical_or(double* __restrict lhs, const double* __restrict rhs, std::size_t rows) {
+    for (std::size_t i = 0; i < rows; ++i)
+        lhs[i] = (lhs[i] != 0.0) | (rhs[i] != 0.0) ? 1.0 : 0.0;
+}
+
+//Whether the left operands of a Jump decide the And / Or for all rows, stops at the first row that does not
+inline bool decides_all(OpCode jump, const double* lhs, std::size_t rows) {
+    for (std::size_t i = 0; i < rows; ++i)
+        if (!decides(jump, lhs[i]))
+            return false;
+    return true;
+}
+
+inline void fill(double* __restrict target, double value, std::size_t rows) {
+    for (std::size_t i = 0; i < rows; ++i)
+        target[i] = value;
+}
 
-    std::cout << "Reading stdin" << std::endl;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMPLEPARSER_X86_KERNELS
+#define SIMPLEPARSER_AVX2 __attribute__((target("avx2,fma")))
+#define SIMPLEPARSER_AVX512 __attribute__((target("avx2,fma,avx512f")))
+#elif defined(__aarch64__) && defined(SIMPLEPARSER_EXPERIMENTAL_NEON)
+// The NEON set has not been built or run on AArch64 yet, so it is only used with -DSIMPLEPARSER_EXPERIMENTAL_NEON
+#define SIMPLEPARSER_NEON_KERNELS
+#endif
+
+// Hand vectorized versions of the batch:: kernels, the rows left over after the last full vector go through the scalar kernel
+// '^' uses pow(a, b) = exp2(b * log2(a)) with polynomial log2/exp2, relative error stays below 1e-13
+// Lanes outside of its range (a <= 0, denormal, inf/nan, results near over-/underflow) fall back to the exact pow()
+namespace batch {
+
+// Coefficients of the polynomials shared by all kernel sets
+// log(m) = 2 * atanh(s) = 2 * (s + s^3 / 3 + s^5 / 5 + ...) with s = (m - 1) / (m + 1)
+constexpr double log_coefficients[] = { 1.0, 1.0 / 3, 1.0 / 5, 1.0 / 7, 1.0 / 9, 1.0 / 11, 1.0 / 13, 1.0 / 15, 1.0 / 17, 1.0 / 19, 1.0 / 21 };
+// exp(t) = sum of t^k / k! for |t| <= ln(2) / 2
+constexpr double exp_coefficients[] = { 1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+                                        1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800 };
+constexpr double two_to_52 = 4503599627370496.0;
+constexpr double ln2 = 0.693147180559945309417;
+// Largest |b * log2(a)| the vector pow handles, the result then still is a normal double
+constexpr double pow_exponent_limit = 1022.0;
+
+#ifdef SIMPLEPARSER_X86_KERNELS
+namespace avx2 {
+
+SIMPLEPARSER_AVX2 inline __m256d log2(__m256d x) {
+    const __m256i bits = _mm256_castpd_si256(x);
+    // The biased exponent bits put into the mantissa of 2^52 turn into a double without a 64 bit conversion
+    const __m256d magic = _mm256_set1_pd(two_to_52);
+    __m256d exponent = _mm256_sub_pd(
+        _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_castpd_si256(magic))),
+        _mm256_set1_pd(two_to_52 + 1023.0));
+    __m256d mantissa = _mm256_castsi256_pd(_mm256_or_si256(
+        _mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFF)), _mm256_set1_epi64x(0x3FF0000000000000)));
+
+    // Mantissa from [1, 2) to [sqrt(0.5), sqrt(2)) keeps |s| small
+    __m256d big = _mm256_cmp_pd(mantissa, _mm256_set1_pd(M_SQRT2), _CMP_GT_OQ);
+    mantissa = _mm256_blendv_pd(mantissa, _mm256_mul_pd(mantissa, _mm256_set1_pd(0.5)), big);
+    exponent = _mm256_add_pd(exponent, _mm256_and_pd(big, _mm256_set1_pd(1.0)));
+
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d s = _mm256_div_pd(_mm256_sub_pd(mantissa, one), _mm256_add_pd(mantissa, one));
+    __m256d s2 = _mm256_mul_pd(s, s);
+    __m256d poly = _mm256_set1_pd(log_coefficients[10]);
+    for (int k = 9; k >= 0; --k)
+        poly = _mm256_fmadd_pd(poly, s2, _mm256_set1_pd(log_coefficients[k]));
+    __m256d log_mantissa = _mm256_mul_pd(_mm256_add_pd(s, s), poly);
+    return _mm256_fmadd_pd(log_mantissa, _mm256_set1_pd(1.0 / ln2), exponent);
+}
+
+SIMPLEPARSER_AVX2 inline __m256d exp2(__m256d y) {
+    __m256d n = _mm256_round_pd(y, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d t = _mm256_mul_pd(_mm256_sub_pd(y, n), _mm256_set1_pd(ln2));
+    __m256d poly = _mm256_set1_pd(exp_coefficients[13]);
+    for (int k = 12; k >= 0; --k)
+        poly = _mm256_fmadd_pd(poly, t, _mm256_set1_pd(exp_coefficients[k]));
+    // 2^n is n + 1023 shifted into the exponent bits, same 2^52 trick as in log2
+    __m256i scale = _mm256_slli_epi64(_mm256_castpd_si256(_mm256_add_pd(n, _mm256_set1_pd(two_to_52 + 1023.0))), 52);
+    return _mm256_mul_pd(poly, _mm256_castsi256_pd(scale));
+}
+
+SIMPLEPARSER_AVX2 inline void add(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 4 <= rows; i += 4)
+        _mm256_storeu_pd(lhs + i, _mm256_add_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+    batch::add(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX2 inline void subtract(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 4 <= rows; i += 4)
+        _mm256_storeu_pd(lhs + i, _mm256_sub_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+    batch::subtract(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX2 inline void multiply(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 4 <= rows; i += 4)
+        _mm256_storeu_pd(lhs + i, _mm256_mul_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+    batch::multiply(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX2 inline void divide(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 4 <= rows; i += 4)
+        _mm256_storeu_pd(lhs + i, _mm256_div_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+    batch::divide(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX2 inline void power(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m256d base = _mm256_loadu_pd(lhs + i), exponent = _mm256_loadu_pd(rhs + i);
+        __m256d y = _mm256_mul_pd(exponent, log2(base));
+        __m256d in_range = _mm256_and_pd(
+            _mm256_and_pd(_mm256_cmp_pd(base, _mm256_set1_pd(DBL_MIN), _CMP_GE_OQ),
+                          _mm256_cmp_pd(base, _mm256_set1_pd(HUGE_VAL), _CMP_LT_OQ)),
+            _mm256_cmp_pd(_mm256_andnot_pd(_mm256_set1_pd(-0.0), y), _mm256_set1_pd(pow_exponent_limit), _CMP_LT_OQ));
+        _mm256_storeu_pd(lhs + i, exp2(y));
+
+        int fast_lanes = _mm256_movemask_pd(in_range);
+        if (fast_lanes != 0xF) {
+            _mm256_storeu_pd(lhs + i, _mm256_blendv_pd(base, _mm256_loadu_pd(lhs + i), in_range));
+            for (int lane = 0; lane < 4; ++lane)
+                if (!(fast_lanes & (1 << lane)))
+                    lhs[i + lane] = pow(lhs[i + lane], rhs[i + lane]);
+        }
+    }
+    batch::power(lhs + i, rhs + i, rows - i);
+}
+
+// && and || as masks of "!= 0" (unordered, so NaN counts as true like bool(NaN)), 1.0 is and-ed in where the mask is set
+SIMPLEPARSER_AVX2 inline void logical_and(double* lhs, const double* rhs, std::size_t rows) {
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+    std::size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m256d mask = _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(lhs + i), zero, _CMP_NEQ_UQ),
+                                     _mm256_cmp_pd(_mm256_loadu_pd(rhs + i), zero, _CMP_NEQ_UQ));
+        _mm256_storeu_pd(lhs + i, _mm256_and_pd(mask, one));
+    }
+    batch::logical_and(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX2 inline void logical_or(double* lhs, const double* rhs, std::size_t rows) {
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+    std::size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m256d mask = _mm256_or_pd(_mm256_cmp_pd(_mm256_loadu_pd(lhs + i), zero, _CMP_NEQ_UQ),
+                                    _mm256_cmp_pd(_mm256_loadu_pd(rhs + i), zero, _CMP_NEQ_UQ));
+        _mm256_storeu_pd(lhs + i, _mm256_and_pd(mask, one));
+    }
+    batch::logical_or(lhs + i, rhs + i, rows - i);
+}
+
+}
+
+namespace avx512 {
+
+// srli, roundscale and scalef go through their zero masked forms with every lane selected: same results, but the
+// plain forms start from an undefined vector that GCC reports as maybe uninitialized wherever they get inlined
+constexpr __mmask8 all = 0xFF;
+
+SIMPLEPARSER_AVX512 inline __m512d log2(__m512d x) {
+    const __m512i bits = _mm512_castpd_si512(x);
+    const __m512d magic = _mm512_set1_pd(two_to_52);
+    __m512d exponent = _mm512_sub_pd(
+        _mm512_castsi512_pd(_mm512_or_si512(_mm512_maskz_srli_epi64(all, bits, 52), _mm512_castpd_si512(magic))),
+        _mm512_set1_pd(two_to_52 + 1023.0));
+    __m512d mantissa = _mm512_castsi512_pd(_mm512_or_si512(
+        _mm512_and_si512(bits, _mm512_set1_epi64(0x000FFFFFFFFFFFFF)), _mm512_set1_epi64(0x3FF0000000000000)));
+
+    __mmask8 big = _mm512_cmp_pd_mask(mantissa, _mm512_set1_pd(M_SQRT2), _CMP_GT_OQ);
+    mantissa = _mm512_mask_mul_pd(mantissa, big, mantissa, _mm512_set1_pd(0.5));
+    exponent = _mm512_mask_add_pd(exponent, big, exponent, _mm512_set1_pd(1.0));
+
+    const __m512d one = _mm512_set1_pd(1.0);
+    __m512d s = _mm512_div_pd(_mm512_sub_pd(mantissa, one), _mm512_add_pd(mantissa, one));
+    __m512d s2 = _mm512_mul_pd(s, s);
+    __m512d poly = _mm512_set1_pd(log_coefficients[10]);
+    for (int k = 9; k >= 0; --k)
+        poly = _mm512_fmadd_pd(poly, s2, _mm512_set1_pd(log_coefficients[k]));
+    __m512d log_mantissa = _mm512_mul_pd(_mm512_add_pd(s, s), poly);
+    return _mm512_fmadd_pd(log_mantissa, _mm512_set1_pd(1.0 / ln2), exponent);
+}
+
+SIMPLEPARSER_AVX512 inline __m512d exp2(__m512d y) {
+    __m512d n = _mm512_maskz_roundscale_pd(all, y, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d t = _mm512_mul_pd(_mm512_sub_pd(y, n), _mm512_set1_pd(ln2));
+    __m512d poly = _mm512_set1_pd(exp_coefficients[13]);
+    for (int k = 12; k >= 0; --k)
+        poly = _mm512_fmadd_pd(poly, t, _mm512_set1_pd(exp_coefficients[k]));
+    return _mm512_maskz_scalef_pd(all, poly, n);
+}
+
+SIMPLEPARSER_AVX512 inline void add(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 8 <= rows; i += 8)
+        _mm512_storeu_pd(lhs + i, _mm512_add_pd(_mm512_loadu_pd(lhs + i), _mm512_loadu_pd(rhs + i)));
+    batch::add(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX512 inline void subtract(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 8 <= rows; i += 8)
+        _mm512_storeu_pd(lhs + i, _mm512_sub_pd(_mm512_loadu_pd(lhs + i), _mm512_loadu_pd(rhs + i)));
+    batch::subtract(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX512 inline void multiply(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 8 <= rows; i += 8)
+        _mm512_storeu_pd(lhs + i, _mm512_mul_pd(_mm512_loadu_pd(lhs + i), _mm512_loadu_pd(rhs + i)));
+    batch::multiply(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX512 inline void divide(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 8 <= rows; i += 8)
+        _mm512_storeu_pd(lhs + i, _mm512_div_pd(_mm512_loadu_pd(lhs + i), _mm512_loadu_pd(rhs + i)));
+    batch::divide(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX512 inline void power(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 8 <= rows; i += 8) {
+        __m512d base = _mm512_loadu_pd(lhs + i), exponent = _mm512_loadu_pd(rhs + i);
+        __m512d y = _mm512_mul_pd(exponent, log2(base));
+        __mmask8 in_range = _mm512_cmp_pd_mask(base, _mm512_set1_pd(DBL_MIN), _CMP_GE_OQ)
+                          & _mm512_cmp_pd_mask(base, _mm512_set1_pd(HUGE_VAL), _CMP_LT_OQ)
+                          & _mm512_cmp_pd_mask(_mm512_abs_pd(y), _mm512_set1_pd(pow_exponent_limit), _CMP_LT_OQ);
+        _mm512_mask_storeu_pd(lhs + i, in_range, exp2(y));
+
+        if (in_range != 0xFF)
+            for (int lane = 0; lane < 8; ++lane)
+                if (!(in_range & (1 << lane)))
+                    lhs[i + lane] = pow(lhs[i + lane], rhs[i + lane]);
+    }
+    batch::power(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX512 inline void logical_and(double* lhs, const double* rhs, std::size_t rows) {
+    const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1.0);
+    std::size_t i = 0;
+    for (; i + 8 <= rows; i += 8) {
+        __mmask8 mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(lhs + i), zero, _CMP_NEQ_UQ)
+                      & _mm512_cmp_pd_mask(_mm512_loadu_pd(rhs + i), zero, _CMP_NEQ_UQ);
+        _mm512_storeu_pd(lhs + i, _mm512_maskz_mov_pd(mask, one));
+    }
+    batch::logical_and(lhs + i, rhs + i, rows - i);
+}
+
+SIMPLEPARSER_AVX512 inline void logical_or(double* lhs, const double* rhs, std::size_t rows) {
+    const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1.0);
+    std::size_t i = 0;
+    for (; i + 8 <= rows; i += 8) {
+        __mmask8 mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(lhs + i), zero, _CMP_NEQ_UQ)
+                      | _mm512_cmp_pd_mask(_mm512_loadu_pd(rhs + i), zero, _CMP_NEQ_UQ);
+        _mm512_storeu_pd(lhs + i, _mm512_maskz_mov_pd(mask, one));
+    }
+    batch::logical_or(lhs + i, rhs + i, rows - i);
+}
+
+}
+#endif
+
+#ifdef SIMPLEPARSER_NEON_KERNELS
+// Experimental, see above. NEON is always there on AArch64, only the arithmetic and logical kernels are vectorized,
+// '^' stays on the scalar pow()
+namespace neon {
+
+inline void add(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 2 <= rows; i += 2)
+        vst1q_f64(lhs + i, vaddq_f64(vld1q_f64(lhs + i), vld1q_f64(rhs + i)));
+    batch::add(lhs + i, rhs + i, rows - i);
+}
+
+inline void subtract(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 2 <= rows; i += 2)
+        vst1q_f64(lhs + i, vsubq_f64(vld1q_f64(lhs + i), vld1q_f64(rhs + i)));
+    batch::subtract(lhs + i, rhs + i, rows - i);
+}
+
+inline void multiply(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 2 <= rows; i += 2)
+        vst1q_f64(lhs + i, vmulq_f64(vld1q_f64(lhs + i), vld1q_f64(rhs + i)));
+    batch::multiply(lhs + i, rhs + i, rows - i);
+}
+
+inline void divide(double* lhs, const double* rhs, std::size_t rows) {
+    std::size_t i = 0;
+    for (; i + 2 <= rows; i += 2)
+        vst1q_f64(lhs + i, vdivq_f64(vld1q_f64(lhs + i), vld1q_f64(rhs + i)));
+    batch::divide(lhs + i, rhs + i, rows - i);
+}
+
+inline void logical_and(double* lhs, const double* rhs, std::size_t rows) {
+    const float64x2_t zero = vdupq_n_f64(0.0), one = vdupq_n_f64(1.0);
+    std::size_t i = 0;
+    for (; i + 2 <= rows; i += 2) {
+        uint64x2_t any_zero = vorrq_u64(vceqzq_f64(vld1q_f64(lhs + i)), vceqzq_f64(vld1q_f64(rhs + i)));
+        vst1q_f64(lhs + i, vbslq_f64(any_zero, zero, one));
+    }
+    batch::logical_and(lhs + i, rhs + i, rows - i);
+}
+
+inline void logical_or(double* lhs, const double* rhs, std::size_t rows) {
+    const float64x2_t zero = vdupq_n_f64(0.0), one = vdupq_n_f64(1.0);
+    std::size_t i = 0;
+    for (; i + 2 <= rows; i += 2) {
+        uint64x2_t both_zero = vandq_u64(vceqzq_f64(vld1q_f64(lhs + i)), vceqzq_f64(vld1q_f64(rhs + i)));
+        vst1q_f64(lhs + i, vbslq_f64(both_zero, zero, one));
+    }
+    batch::logical_or(lhs + i, rhs + i, rows - i);
+}
+
+}
+#endif
+
+}
+
+// One set of Operator kernels for the BatchEvaluator
+struct BatchKernels {
+    using Kernel = void (*)(double*, const double*, std::size_t);
+
+    const char* name;
+    Kernel add, subtract, multiply, divide, power, logical_and, logical_or;
+};
+
+const BatchKernels scalar_kernels = { "scalar", batch::add, batch::subtract, batch::multiply, batch::divide,
+                                      batch::power, batch::logical_and, batch::logical_or };
+#ifdef SIMPLEPARSER_X86_KERNELS
+const BatchKernels avx2_kernels = { "avx2", batch::avx2::add, batch::avx2::subtract, batch::avx2::multiply, batch::avx2::divide,
+                                    batch::avx2::power, batch::avx2::logical_and, batch::avx2::logical_or };
+const BatchKernels avx512_kernels = { "avx512", batch::avx512::add, batch::avx512::subtract, batch::avx512::multiply, batch::avx512::divide,
+                                      batch::avx512::power, batch::avx512::logical_and, batch::avx512::logical_or };
+#endif
+#ifdef SIMPLEPARSER_NEON_KERNELS
+const BatchKernels neon_kernels = { "neon", batch::neon::add, batch::neon::subtract, batch::neon::multiply, batch::neon::divide,
+                                    batch::power, batch::neon::logical_and, batch::neon::logical_or };
+#endif
+
+// How the kernel sets compute '^': Exact calls pow() for every row like the tree, bytecode and JIT evaluators do,
+// Approximate keeps the vector exp2(b * log2(a)) of the AVX2 / AVX-512 sets, several times faster but with a relative
+// error of up to 1e-13, so its results can differ from the other evaluators in the last digits
+enum class BatchPower { Exact, Approximate };
+
+//Widest kernel set the CPU supports, checked once on first use; '^' is exact unless Approximate is asked for
+const BatchKernels& batch_kernels(BatchPower power = BatchPower::Exact) {
+    static const BatchKernels& selected = []() -> const BatchKernels& {
+#ifdef SIMPLEPARSER_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return avx512_kernels;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return avx2_kernels;
+#endif
+#ifdef SIMPLEPARSER_NEON_KERNELS
+        return neon_kernels;
+#endif
+        return scalar_kernels;
+    }();
+    static const BatchKernels exact = [] {
+        BatchKernels kernels = selected;
+        kernels.power = batch::power;
+        return kernels;
+    }();
+    return power == BatchPower::Exact ? exact : selected;
+}
+
+// Evaluates one CompiledExpression for many rows of variable values (one column array per variable)
+// Every Instruction processes a block of rows at once on stack "registers" that are whole arrays instead of single doubles
+// Keeps its registers between calls, so one evaluator should be reused for many batches (one per thread)
+class BatchEvaluator {
+public:
+    //How the Jumps of && / || are taken: ShortCircuit skips the right operand for a block once the left one decides
+    //every row of it (one test per block, not per row), Branchless always runs both sides through the mask kernels
+    enum class Logic { ShortCircuit, Branchless };
+
+    //Defaults to the widest kernel set of the CPU with the exact '^', so every row gets the digits a single evaluation
+    //would print; others can be passed in f.e. to compare them or to trade exactness of '^' for speed
+    explicit BatchEvaluator(const BatchKernels& kernels = batch_kernels(), Logic logic = Logic::ShortCircuit)
+        : kernels(kernels), logic(logic) { }
+
+    //Rows per block, small enough that all registers of a Program stay in the cache
+    static constexpr std::size_t block_size = 256;
+
+    //columns[slot] holds rows values of a variable, a nullptr column takes scalars[slot] for every row instead
+    //Assignments yield the new value of their variable per row, neither columns nor scalars are modified
+    void evaluate(const CompiledExpression& program, const double* const* columns, const double* scalars,
+                  std::size_t rows, double* out) {
+        // One register more than the Program needs, compound assignments load their variable into it
+        registers.resize((program.stack_size() + 1) * block_size);
+
+        for (std::size_t first = 0; first < rows; first += block_size) {
+            std::size_t count = std::min(block_size, rows - first);
+            evaluate_block(program, columns, scalars, first, count);
+            std::copy(registers.begin(), registers.begin() + count, out + first);
+        }
+    }
+
+private:
+    void evaluate_block(const CompiledExpression& program, const double* const* columns, const double* scalars,
+                        std::size_t first, std::size_t count) {
+        double* stack = registers.data();
+        std::size_t top = 0;
+        auto reg = [stack](std::size_t index) { return stack + index * block_size; };
+
+        InstructionRange range = program.instructions();
+        for (const Instruction* next = range.begin(); next != range.end(); ++next) {
+            const Instruction& instruction = *next;
+            switch (instruction.op) {
+                case OpCode::PushConstant: batch::fill(reg(top++), instruction.constant, count); break;
+                case OpCode::PushVariable:
+                    load_variable(reg(top++), columns, scalars, instruction.variable, first, count);
+                    break;
+                case OpCode::Add: --top; kernels.add(reg(top - 1), reg(top), count); break;
+                case OpCode::Subtract: --top; kernels.subtract(reg(top - 1), reg(top), count); break;
+                case OpCode::Multiply: --top; kernels.multiply(reg(top - 1), reg(top), count); break;
+                case OpCode::Divide: --top; kernels.divide(reg(top - 1), reg(top), count); break;
+                case OpCode::Power: --top; kernels.power(reg(top - 1), reg(top), count); break;
+                case OpCode::And: --top; kernels.logical_and(reg(top - 1), reg(top), count); break;
+                case OpCode::Or: --top; kernels.logical_or(reg(top - 1), reg(top), count); break;
+                case OpCode::JumpIfFalse:
+                case OpCode::JumpIfTrue:
+                    if (logic == Logic::ShortCircuit && batch::decides_all(instruction.op, reg(top - 1), count)) {
+                        batch::fill(reg(top - 1), decided_value(instruction.op), count);
+                        next += instruction.variable;
+                    }
+                    break;
+                case OpCode::Assign: break;
+                default: {
+                    // Compound assignment: the current value of the variable is the left hand side
+                    double* value = reg(top - 1);
+                    double* variable = reg(top);
+                    load_variable(variable, columns, scalars, instruction.variable, first, count);
+                    if (instruction.op == OpCode::AssignAdd)
+                        kernels.add(variable, value, count);
+                    else if (instruction.op == OpCode::AssignSubtract)
+                        kernels.subtract(variable, value, count);
+                    else if (instruction.op == OpCode::AssignMultiply)
+                        kernels.multiply(variable, value, count);
+                    else
+                        kernels.divide(variable, value, count);
+                    std::copy(variable, variable + count, value);
+                }
+            }
+        }
+    }
+
+    static void load_variable(double* target, const double* const* columns, const double* scalars,
+                              std::uint32_t slot, std::size_t first, std::size_t count) {
+        if (columns[slot])
+            std::copy(columns[slot] + first, columns[slot] + first + count, target);
+        else
+            batch::fill(target, scalars[slot], count);
+    }
+
+    const BatchKernels& kernels;
+    Logic logic;
+    std::vector<double> registers;
+};
+
+/******************************************************************************/
+
+#if defined(__x86_64__) && defined(__linux__)
+#define SIMPLEPARSER_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Executable memory of all JitFunctions of the process. Code is packed into blocks of block_size, many small functions
+// share pages (and iTLB entries) instead of taking a page each, which made calling a short one slower than interpreting
+// Every block is mapped twice from one memfd: written through a read / write view and run from a read / execute one,
+// so no page is ever writable and executable and adding a function never changes the protection of code other threads
+// may be running. A block is unmapped once the arena moved on to the next and its last JitFunction is gone
+class JitArena {
+public:
+    static JitArena& shared() {
+        static JitArena arena;
+        return arena;
+    }
+
+    //Executable copy of code, nullptr if no memory could be mapped. owner keeps its block mapped
+    const std::uint8_t* add(const std::vector<std::uint8_t>& code, std::shared_ptr<const void>& owner) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Functions start on 16 bytes like the ones of the compiler
+        std::size_t offset = current ? (current->used + 15) & ~std::size_t(15) : 0;
+        if (!current || offset + code.size() > current->size) {
+            std::shared_ptr<Block> block = map(std::max(block_size, (code.size() + 4095) & ~std::size_t(4095)));
+            if (!block)
+                return nullptr;
+            current = std::move(block);
+            offset = 0;
+        }
+        std::copy(code.begin(), code.end(), current->writable + offset);
+        current->used = offset + code.size();
+        owner = current;
+        return current->executable + offset;
+    }
+
+private:
+    static constexpr std::size_t block_size = 64 << 10;
+
+    struct Block {
+        std::uint8_t* writable = nullptr;
+        const std::uint8_t* executable = nullptr;
+        std::size_t size = 0, used = 0;
+
+        ~Block() {
+            if (writable)
+                munmap(writable, size);
+            if (executable)
+                munmap(const_cast<std::uint8_t*>(executable), size);
+        }
+    };
+
+    static std::shared_ptr<Block> map(std::size_t size) {
+        int file = memfd_create("simpleparser-jit", MFD_CLOEXEC);
+        if (file < 0)
+            return nullptr;
+        auto block = std::make_shared<Block>();
+        block->size = size;
+        if (ftruncate(file, off_t(size)) == 0) {
+            void* writable = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+            void* executable = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_SHARED, file, 0);
+            if (writable != MAP_FAILED)
+                block->writable = static_cast<std::uint8_t*>(writable);
+            if (executable != MAP_FAILED)
+                block->executable = static_cast<const std::uint8_t*>(executable);
+        }
+        close(file);
+        return block->writable && block->executable ? block : nullptr;
+    }
+
+    std::mutex mutex;
+    //Block new code goes into, the older ones live on in their JitFunctions
+    std::shared_ptr<Block> current;
+};
+#endif
+
+// Native code for one CompiledExpression: double f(double* variables), the variables are indexed by slot like in evaluate()
+// The code lives in the JitArena, empty if the Program could not be compiled
+class JitFunction {
+public:
+    using Function = double (*)(double*);
+
+    JitFunction() = default;
+
+    JitFunction(JitFunction&& other) noexcept : function(other.function), memory(std::move(other.memory)) {
+        other.function = nullptr;
+    }
+
+    JitFunction& operator=(JitFunction&& other) noexcept {
+        std::swap(function, other.function);
+        std::swap(memory, other.memory);
+        return *this;
+    }
+
+    //Copies code into the executable memory of the JitArena
+    static JitFunction load(const std::vector<std::uint8_t>& code) {
+        JitFunction jit;
+#ifdef SIMPLEPARSER_JIT
+        if (const std::uint8_t* entry = JitArena::shared().add(code, jit.memory))
+            jit.function = reinterpret_cast<Function>(const_cast<std::uint8_t*>(entry));
+#else
+        (void)code;
+#endif
+        return jit;
+    }
+
+    explicit operator bool() const {
+        return function != nullptr;
+    }
+
+    double operator()(double* variables) const {
+        return function(variables);
+    }
+
+private:
+    Function function = nullptr;
+    //Block of the JitArena the code is in
+    std::shared_ptr<const void> memory;
+};
+
+#ifdef SIMPLEPARSER_JIT
+// Minimal x86-64 (SSE2, System V ABI) emitter for the stack machine
+// Stack entry i lives in xmm<i>, xmm15 is scratch, the variables pointer is kept in rbx across calls to pow()
+class X86Emitter {
+public:
+    //xmm0 - xmm14 hold the stack
+    static constexpr std::size_t max_stack = 15;
+
+    void prologue() {
+        emit({ 0x53 });                                     // push rbx
+        emit({ 0x48, 0x89, 0xFB });                         // mov rbx, rdi
+        emit({ 0x48, 0x81, 0xEC }); emit32(spill_area);     // sub rsp, spill_area (keeps rsp 16 byte aligned)
+    }
+
+    void epilogue() {
+        emit({ 0x48, 0x81, 0xC4 }); emit32(spill_area);     // add rsp, spill_area
+        emit({ 0x5B, 0xC3 });                               // pop rbx; ret
+    }
+
+    void load_constant(int xmm, double value) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        mov_rax(bits);
+        emit({ 0x66, std::uint8_t(0x48 | (xmm >= 8 ? 0x04 : 0)), 0x0F, 0x6E, modrm_rr(xmm, 0) }); // movq xmm, rax
+    }
+
+    void load_variable(int xmm, std::uint32_t slot) { sse_mem(0xF2, 0x10, xmm, rbx, 8 * slot); }   // movsd xmm, [rbx + 8 * slot]
+    void store_variable(int xmm, std::uint32_t slot) { sse_mem(0xF2, 0x11, xmm, rbx, 8 * slot); }  // movsd [rbx + 8 * slot], xmm
+    void add(int dst, int src) { sse_rr(0xF2, 0x58, dst, src); }       // addsd
+    void multiply(int dst, int src) { sse_rr(0xF2, 0x59, dst, src); }  // mulsd
+    void subtract(int dst, int src) { sse_rr(0xF2, 0x5C, dst, src); }  // subsd
+    void divide(int dst, int src) { sse_rr(0xF2, 0x5E, dst, src); }    // divsd
+    void move(int dst, int src) { sse_rr(0x66, 0x28, dst, src); }      // movapd
+
+    //&& / ||: "!= 0" masks of both sides (cmpneqsd is true for NaN as well), and-ed / or-ed, the mask then selects 1.0
+    void logical(int dst, int src, bool is_and) {
+        sse_rr(0x66, 0x57, scratch, scratch);                      // xorpd xmm15, xmm15
+        sse_rr(0xF2, 0xC2, dst, scratch); emit({ 0x04 });          // cmpneqsd dst, xmm15
+        sse_rr(0xF2, 0xC2, src, scratch); emit({ 0x04 });          // cmpneqsd src, xmm15
+        sse_rr(0x66, is_and ? 0x54 : 0x56, dst, src);              // andpd / orpd dst, src
+        load_constant(scratch, 1.0);
+        sse_rr(0x66, 0x54, dst, scratch);                          // andpd dst, xmm15
+    }
+
+    //Jump of && / ||: if xmm decides the result (ucomisd against 0, unordered counts as true), xmm becomes the result
+    //and a jmp skips the right operand. Returns the jmp for land()
+    std::size_t jump_if_decided(int xmm, bool is_and) {
+        sse_rr(0x66, 0x57, scratch, scratch);                      // xorpd xmm15, xmm15
+        sse_rr(0x66, 0x2E, xmm, scratch);                          // ucomisd xmm, xmm15
+        // NaN is true: it leaves && undecided and decides ||
+        std::size_t unordered = short_jump(0x7A);                  // jp
+        std::size_t undecided = short_jump(is_and ? 0x75 : 0x74);  // jne (&&) / je (||)
+        if (is_and) {
+            sse_rr(0x66, 0x57, xmm, xmm);                          // xorpd xmm, xmm
+        } else {
+            land_short(unordered);
+            load_constant(xmm, 1.0);
+        }
+        emit({ 0xE9 });                                            // jmp rel32
+        std::size_t jump = bytes.size();
+        emit32(0);
+        if (is_and)
+            land_short(unordered);
+        land_short(undecided);
+        return jump;
+    }
+
+    //Lets a jmp of jump_if_decided() continue at the current end of the code
+    void land(std::size_t jump) {
+        std::uint32_t distance = std::uint32_t(bytes.size() - (jump + 4));
+        for (int i = 0; i < 4; ++i)
+            bytes[jump + i] = std::uint8_t(distance >> (8 * i));
+    }
+
+    //dst = pow(dst, dst + 1), the stack entries below dst are saved around the call as all xmm registers are caller saved
+    void power(int dst) {
+        for (int i = 0; i < dst; ++i)
+            sse_mem(0xF2, 0x11, i, rsp, 8 * i);
+        if (dst != 0) {
+            move(0, dst);
+            move(1, dst + 1);
+        }
+        double (*function)(double, double) = pow;
+        mov_rax(reinterpret_cast<std::uint64_t>(function));
+        emit({ 0xFF, 0xD0 });                                      // call rax
+        if (dst != 0)
+            move(dst, 0);
+        for (int i = 0; i < dst; ++i)
+            sse_mem(0xF2, 0x10, i, rsp, 8 * i);
+    }
+
+    static constexpr int scratch = 15;
+
+    const std::vector<std::uint8_t>& code() const {
+        return bytes;
+    }
+
+private:
+    static constexpr std::uint32_t spill_area = 128;
+    static constexpr int rsp = 4, rbx = 3;
+
+    void emit(std::initializer_list<std::uint8_t> values) {
+        bytes.insert(bytes.end(), values);
+    }
+
+    void emit32(std::uint32_t value) {
+        for (int i = 0; i < 4; ++i)
+            bytes.push_back(std::uint8_t(value >> (8 * i)));
+    }
+
+    //Conditional jump with an 8 bit displacement that land_short() fills in, both sides are only a few bytes apart
+    std::size_t short_jump(std::uint8_t opcode) {
+        emit({ opcode, 0 });
+        return bytes.size() - 1;
+    }
+
+    void land_short(std::size_t jump) {
+        bytes[jump] = std::uint8_t(bytes.size() - (jump + 1));
+    }
+
+    void mov_rax(std::uint64_t value) {
+        emit({ 0x48, 0xB8 });                                      // mov rax, imm64
+        for (int i = 0; i < 8; ++i)
+            bytes.push_back(std::uint8_t(value >> (8 * i)));
+    }
+
+    static std::uint8_t modrm_rr(int reg, int rm) {
+        return std::uint8_t(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    //Mandatory prefix, optional REX for xmm8 - xmm15, 0F opcode, register to register ModRM
+    void sse_rr(std::uint8_t prefix, std::uint8_t opcode, int dst, int src) {
+        bytes.push_back(prefix);
+        if (dst >= 8 || src >= 8)
+            bytes.push_back(std::uint8_t(0x40 | (dst >= 8 ? 0x04 : 0) | (src >= 8 ? 0x01 : 0)));
+        emit({ 0x0F, opcode, modrm_rr(dst, src) });
+    }
+
+    //Same with a [base + disp32] memory operand
+    void sse_mem(std::uint8_t prefix, std::uint8_t opcode, int xmm, int base, std::uint32_t displacement) {
+        bytes.push_back(prefix);
+        if (xmm >= 8)
+            bytes.push_back(0x44);
+        emit({ 0x0F, opcode, std::uint8_t(0x80 | ((xmm & 7) << 3) | base) });
+        if (base == rsp)
+            bytes.push_back(0x24);                                 // SIB: [rsp]
+        emit32(displacement);
+    }
+
+    std::vector<std::uint8_t> bytes;
+};
+#endif
+
+//Lowers a Program to native code, empty if there is no backend for this platform or the stack does not fit the registers
+JitFunction jit_compile(const CompiledExpression& program) {
+#ifdef SIMPLEPARSER_JIT
+    if (program.stack_size() > X86Emitter::max_stack)
+        return JitFunction();
+
+    X86Emitter emitter;
+    emitter.prologue();
+    int top = 0;
+    // Jumps still waiting for their target (index of the Instruction after their And / Or), innermost on top
+    std::vector<std::pair<std::size_t, std::size_t>> landings;
+    InstructionRange range = program.instructions();
+    for (std::size_t index = 0; index < range.size(); ++index) {
+        const Instruction& instruction = range[index];
+        for (; !landings.empty() && landings.back().first == index; landings.pop_back())
+            emitter.land(landings.back().second);
+        switch (instruction.op) {
+            case OpCode::PushConstant: emitter.load_constant(top++, instruction.constant); break;
+            case OpCode::PushVariable: emitter.load_variable(top++, instruction.variable); break;
+            case OpCode::Add: --top; emitter.add(top - 1, top); break;
+            case OpCode::Subtract: --top; emitter.subtract(top - 1, top); break;
+            case OpCode::Multiply: --top; emitter.multiply(top - 1, top); break;
+            case OpCode::Divide: --top; emitter.divide(top - 1, top); break;
+            case OpCode::Power: --top; emitter.power(top - 1); break;
+            case OpCode::And: --top; emitter.logical(top - 1, top, true); break;
+            case OpCode::Or: --top; emitter.logical(top - 1, top, false); break;
+            case OpCode::JumpIfFalse:
+            case OpCode::JumpIfTrue:
+                landings.push_back({ index + instruction.variable + 1,
+                                     emitter.jump_if_decided(top - 1, instruction.op == OpCode::JumpIfFalse) });
+                break;
+            case OpCode::Assign: emitter.store_variable(top - 1, instruction.variable); break;
+            default: {
+                // Compound assignment on the scratch register, the new value replaces the top of the stack
+                const int variable = X86Emitter::scratch;
+                emitter.load_variable(variable, instruction.variable);
+                if (instruction.op == OpCode::AssignAdd)
+                    emitter.add(variable, top - 1);
+                else if (instruction.op == OpCode::AssignSubtract)
+                    emitter.subtract(variable, top - 1);
+                else if (instruction.op == OpCode::AssignMultiply)
+                    emitter.multiply(variable, top - 1);
+                else
+                    emitter.divide(variable, top - 1);
+                emitter.store_variable(variable, instruction.variable);
+                emitter.move(top - 1, variable);
+            }
+        }
+    }
+    for (; !landings.empty(); landings.pop_back())
+        emitter.land(landings.back().second);
+    emitter.epilogue();
+    return JitFunction::load(emitter.code());
+#else
+    (void)program;
+    return JitFunction();
+#endif
+}
+
+// A Program that starts out in the interpreter and gets compiled to native code once it was evaluated threshold times
+// If the JIT can not handle it, it just stays in the interpreter. One HotExpression must not be shared between threads
+// The entries of the ExpressionCache are HotExpressions, so a line that keeps coming back ends up running natively
+class HotExpression {
+public:
+    static constexpr std::size_t default_threshold = 1000;
+
+    HotExpression() = default;
+
+    explicit HotExpression(CompiledExpression program, std::size_t threshold = default_threshold)
+        : program(std::move(program)), threshold(threshold) { }
+
+    double evaluate(double* variables) {
+        if (native)
+            return native(variables);
+        if (++evaluations == threshold)
+            native = jit_compile(program);
+        return program.evaluate(variables);
+    }
+
+    bool is_native() const {
+        return bool(native);
+    }
+
+    const CompiledExpression& compiled() const {
+        return program;
+    }
+
+private:
+    CompiledExpression program;
+    std::size_t threshold = default_threshold, evaluations = 0;
+    JitFunction native;
+};
+
+/******************************************************************************/
+// EBNF of this Grammar:
+//      varname = "A" .. "z" , { <alphanumeric> }
+//      start = (varname, ("=" | "+=" | "-=" | "*=" | "/=") , term) | term
+//      term = product, { ("+" | "-"), product }
+//      product = power, { ("*" | "/" | "&&" | "||"), power }
+//      power = factor, [ "^", power ]
+//      factor = group | varname | double-number
+//      group = "(", term, ")"
+
+
+#ifndef SIMPLEPARSER_USE_QI
+// Character classes of the lexer, one table lookup instead of the locale aware <cctype> calls
+namespace chars {
+
+enum Class : std::uint8_t { Space = 1, Alpha = 2, Digit = 4 };
+
+constexpr std::array<std::uint8_t, 256> make_classes() {
+    std::array<std::uint8_t, 256> classes{};
+    for (int c : { ' ', '\t', '\n', '\v', '\f', '\r' })
+        classes[c] = Space;
+    for (int c = 'a'; c <= 'z'; ++c)
+        classes[c] = classes[c - 'a' + 'A'] = Alpha;
+    for (int c = '0'; c <= '9'; ++c)
+        classes[c] = Digit;
+    return classes;
+}
+
+constexpr std::array<std::uint8_t, 256> classes = make_classes();
+
+inline bool is(char c, std::uint8_t mask) {
+    return (classes[static_cast<unsigned char>(c)] & mask) != 0;
+}
+
+//First character at or after first that is not in mask
+inline const char* skip(const char* first, const char* last, std::uint8_t mask) {
+    while (first != last && is(*first, mask))
+        ++first;
+    return first;
+}
+
+}
+
+// Decimal numbers without sign, inf or nan ("12", "1.5", ".5e-3") with at most 19 significant digits and a power of
+// ten up to 22 are converted exactly like the fast path of fast_float: the mantissa is exact in a double and so is the
+// power of ten, one multiplication or division rounds correctly. Anything else returns nullptr, from_chars takes over
+// Otherwise returns the end of the number, which is the same from_chars would stop at
+inline const char* parse_decimal(const char* first, const char* last, double& value) {
+    static constexpr double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    std::uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    const char* p = first;
+    for (; p != last && chars::is(*p, chars::Digit); ++p, digits += mantissa != 0)
+        mantissa = mantissa * 10 + std::uint64_t(*p - '0');
+    bool any = p != first;
+    if (p != last && *p == '.') {
+        const char* fraction = ++p;
+        for (; p != last && chars::is(*p, chars::Digit); ++p, digits += mantissa != 0)
+            mantissa = mantissa * 10 + std::uint64_t(*p - '0');
+        exponent = -int(p - fraction);
+        any = any || p != fraction;
+    }
+    if (!any || digits > 19)
+        return nullptr;
+    // The exponent only belongs to the number if digits follow, "1e" and "1e+" end before the 'e'
+    if (p != last && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negative = q != last && *q == '-';
+        if (q != last && (*q == '-' || *q == '+'))
+            ++q;
+        if (q != last && chars::is(*q, chars::Digit)) {
+            int written = 0;
+            for (; q != last && chars::is(*q, chars::Digit); ++q)
+                if (written < 10000)
+                    written = written * 10 + (*q - '0');
+            exponent += negative ? -written : written;
+            p = q;
+        }
+    }
+    if (mantissa > (std::uint64_t(1) << 53) || exponent < -22 || exponent > 22)
+        return mantissa == 0 && exponent <= 22 ? (value = 0.0, p) : nullptr;
+    value = exponent < 0 ? double(mantissa) / powers[-exponent] : double(mantissa) * powers[exponent];
+    return p;
+}
+
+// One token of a line, offset and length point into the line
+// Operators, assignments and signs reuse the OpCodes, a name may contain spaces ("a b" is the varname "ab")
+struct Token {
+    enum Kind : std::uint8_t { End, Name, Number, Operator, Assignment, Open, Close, Invalid };
+
+    Kind kind;
+    OpCode op;
+    bool spaced;
+    std::uint32_t offset, length;
+    double value;
+};
+
+// Splits a line into Tokens before the parser looks at it, so every character is classified exactly once
+// Signs are ambiguous: where an operand is expected (at the start, after an operator, '(' or assignment) a sign that
+// starts a number is part of it ("2*-1"), everywhere else it is an operator ("2-1"). The Qi grammar decides the same way,
+// as its double_ is only tried in factor. Lexing stops at the first character no token can start with
+class Lexer {
+public:
+    //Splits input into tokens(), always terminated by End
+    //False if input has more than max_operands Tokens other than parentheses, then tokens() holds only the first ones
+    bool tokenize(std::string_view input, std::size_t max_operands) {
+        list.clear();
+        std::size_t operands = 0;
+        const char* first = input.data();
+        const char* last = first + input.size();
+        const char* p = chars::skip(first, last, chars::Space);
+        bool operand = true;
+        while (p != last) {
+            const char* begin = p;
+            Token token{ Token::Invalid, OpCode::PushConstant, false, std::uint32_t(p - first), 0, 0.0 };
+            char c = *p;
+            char next = p + 1 != last ? p[1] : '\0';
+            bool sign = operand && (c == '+' || c == '-') && next != '=';
+            if (chars::is(c, chars::Alpha)) {
+                token.kind = Token::Name;
+                p = name(p, last, token.spaced);
+            } else if (chars::is(c, chars::Digit) || c == '.' || sign) {
+                if (const char* end = number(p, last, token.value)) {
+                    token.kind = Token::Number;
+                    p = end;
+                } else if (c == '+' || c == '-') {
+                    // Not a signed number, the parser is going to fail on the operator where it expects an operand
+                    token.kind = Token::Operator;
+                    token.op = c == '+' ? OpCode::Add : OpCode::Subtract;
+                    ++p;
+                }
+            } else if (next == '=' && (c == '+' || c == '-' || c == '*' || c == '/')) {
+                token.kind = Token::Assignment;
+                token.op = c == '+' ? OpCode::AssignAdd : c == '-' ? OpCode::AssignSubtract
+                         : c == '*' ? OpCode::AssignMultiply : OpCode::AssignDivide;
+                p += 2;
+            } else if (c == '=') {
+                token.kind = Token::Assignment;
+                token.op = OpCode::Assign;
+                ++p;
+            } else if (c == '(' || c == ')') {
+                token.kind = c == '(' ? Token::Open : Token::Close;
+                ++p;
+            } else if ((c == '&' || c == '|') && next == c) {
+                token.kind = Token::Operator;
+                token.op = c == '&' ? OpCode::And : OpCode::Or;
+                p += 2;
+            } else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '^') {
+                token.kind = Token::Operator;
+                token.op = c == '+' ? OpCode::Add : c == '-' ? OpCode::Subtract : c == '*' ? OpCode::Multiply
+                         : c == '/' ? OpCode::Divide : OpCode::Power;
+                ++p;
+            }
+            token.length = std::uint32_t(p - begin);
+            if (token.kind != Token::Open && token.kind != Token::Close && ++operands > max_operands)
+                return false;
+            list.push_back(token);
+            // Nothing after it can be parsed anyway, the parser fails at the Invalid Token
+            if (token.kind == Token::Invalid)
+                break;
+            operand = token.kind != Token::Name && token.kind != Token::Number && token.kind != Token::Close;
+            p = chars::skip(p, last, chars::Space);
+        }
+        list.push_back({ Token::End, OpCode::PushConstant, false, std::uint32_t(p - first), 0, 0.0 });
+        return true;
+    }
+
+    const std::vector<Token>& tokens() const {
+        return list;
+    }
+
+private:
+    //alpha followed by any number of alnum, spaces in between are skipped as the Qi rule does
+    static const char* name(const char* p, const char* last, bool& spaced) {
+        for (;;) {
+            p = chars::skip(p + 1, last, chars::Alpha | chars::Digit);
+            const char* after = chars::skip(p, last, chars::Space);
+            if (after == p || after == last || !chars::is(*after, chars::Alpha | chars::Digit))
+                return p;
+            spaced = true;
+            p = after;
+        }
+    }
+
+    //Same syntax as qi::double_ (sign, inf / nan, optional dot and exponent), nullptr if there is no number at first
+    static const char* number(const char* first, const char* last, double& value) {
+        bool negative = *first == '-';
+        const char* digits = first + (*first == '-' || *first == '+');
+        if (const char* end = parse_decimal(digits, last, value)) {
+            value = negative ? -value : value;
+            return end;
+        }
+        // from_chars knows no leading '+', but qi::double_ only allows one sign anyway
+        if (*first == '+') {
+            ++first;
+            if (first != last && (*first == '+' || *first == '-'))
+                return nullptr;
+        }
+        std::from_chars_result result = std::from_chars(first, last, value);
+        if (result.ec == std::errc::result_out_of_range) {
+            // qi::double_ rejects overflows, but flushes underflows to zero
+            double parsed = std::strtod(std::string(first, result.ptr).c_str(), nullptr);
+            if (std::isinf(parsed))
+                return nullptr;
+            value = parsed;
+        } else if (result.ec != std::errc()) {
+            return nullptr;
+        }
+        // qi::double_ takes anything up to the next ')' as the payload of a nan, and fails if there is none
+        // from_chars already took payloads made of alnum and '_', so only a bare "nan" is looked at
+        if (std::isnan(value) && (result.ptr[-1] == 'n' || result.ptr[-1] == 'N') && result.ptr != last && *result.ptr == '(') {
+            result.ptr = std::find(result.ptr, last, ')');
+            if (result.ptr == last)
+                return nullptr;
+            ++result.ptr;
+        }
+        return result.ptr;
+    }
+
+    std::vector<Token> list;
+};
+
+// Hand-written recursive descent parser for the EBNF above, the default frontend (make PARSER=qi builds the Qi grammar)
+// Takes the same decisions as the Qi grammar, so accepted inputs, trees and the unparsed rest of errors are identical:
+// spaces are skipped before every token (also inside varnames, "a b" is "ab"), a failed "operator operand" pair is
+// rolled back and ends its rule, and everything else that fails fails the whole input
+// Works on the Tokens of the Lexer, backtracking only resets the index of the current Token
+class ExpressionParser {
+public:
+    //Appends the Nodes of input to builder.tree and returns the root, throws ParseError like PhraseParseOrDie
+    //and LimitExceeded for an input over the limits()
+    NodeIndex parse(std::string_view input, const NodeBuilder& builder) {
+        NodeIndex root = 0;
+        std::size_t unparsed = 0;
+        ParseStatus result = try_parse(input, builder, root, unparsed);
+        if (result == ParseStatus::Failed)
+            throw ParseError(std::string(input.substr(unparsed)));
+        if (result != ParseStatus::Ok)
+            throw LimitExceeded(result);
+        return root;
+    }
+
+    //Same without exceptions, for Failed unparsed is the offset of the rest of input it could not consume
+    //A limit ends the parse wherever it is hit, the rules unwind like after any failure and the status tells why
+    ParseStatus try_parse(std::string_view input, const NodeBuilder& builder, NodeIndex& root, std::size_t& unparsed) {
+        const Limits& limit = limits();
+        max_nodes = limit.max_nodes;
+        max_nesting = limit.max_nesting;
+        // Every Token but the parentheses becomes a Node (the target of an assignment becomes part of one), so an
+        // input with more of them can not parse into max_nodes Nodes: it is not even lexed to its end
+        // The bound saturates, a limit of SIZE_MAX must not wrap around to no Tokens at all
+        std::size_t max_operands = max_nodes < std::numeric_limits<std::size_t>::max() ? max_nodes + 1 : max_nodes;
+        if (!lexer.tokenize(input, max_operands))
+            return ParseStatus::TooManyNodes;
+        text = input;
+        tokens = lexer.tokens().data();
+        current = 0;
+        tree = builder.tree;
+        symbols = builder.symbols;
+        depth = 0;
+        operands.clear();
+        status = ParseStatus::Ok;
+
+        bool parsed = start(root);
+        if (status != ParseStatus::Ok)
+            return status;
+        unparsed = parsed ? tokens[current].offset : 0;
+        return parsed && tokens[current].kind == Token::End ? ParseStatus::Ok : ParseStatus::Failed;
+    }
+
+    //Memory of the Tokens, the varname and the power operand buffers, all keep the size of the largest input they ever held
+    std::size_t bytes() const {
+        return lexer.tokens().capacity() * sizeof(Token) + name.capacity() + operands.capacity() * sizeof(NodeIndex);
+    }
+
+private:
+    //Binary operator of the current Token if op is one of the alternatives of the rule
+    bool operator_token(std::initializer_list<OpCode> alternatives, OpCode& op) const {
+        const Token& token = tokens[current];
+        if (token.kind != Token::Operator)
+            return false;
+        op = token.op;
+        return std::find(alternatives.begin(), alternatives.end(), op) != alternatives.end();
+    }
+
+    bool start(NodeIndex& out) {
+        std::size_t begin = current;
+        if (assignment(out))
+            return true;
+        // No need to try the term after a limit, the status is all that is left to tell
+        if (status != ParseStatus::Ok)
+            return false;
+        current = begin;
+        return term(out);
+    }
+
+    bool assignment(NodeIndex& out) {
+        if (tokens[current].kind != Token::Name || tokens[current + 1].kind != Token::Assignment)
+            return false;
+        // The term may parse varnames of its own, and the target is resolved after them like in the Qi action
+        const Token& target = tokens[current];
+        OpCode op = tokens[current + 1].op;
+        current += 2;
+
+        NodeIndex value;
+        std::uint32_t slot;
+        if (!term(value) || !room() || !resolve(target, slot))
+            return false;
+        out = tree->assignment(op, slot, value);
+        return true;
+    }
+
+    bool term(NodeIndex& out) {
+        if (!product(out))
+            return false;
+        OpCode op;
+        while (operator_token({ OpCode::Add, OpCode::Subtract }, op)) {
+            std::size_t before = current++;
+            NodeIndex right;
+            if (!product(right)) {
+                current = before;
+                break;
+            }
+            if (!room())
+                return false;
+            out = tree->binary(op, out, right);
+        }
+        return true;
+    }
+
+    bool product(NodeIndex& out) {
+        if (!power(out))
+            return false;
+        OpCode op;
+        while (operator_token({ OpCode::Multiply, OpCode::Divide, OpCode::And, OpCode::Or }, op)) {
+            std::size_t before = current++;
+            NodeIndex right;
+            if (!power(right)) {
+                current = before;
+                break;
+            }
+            if (!room())
+                return false;
+            out = tree->binary(op, out, right);
+        }
+        return true;
+    }
+
+    // Right associative, "2 ^ 3 ^ 2" is "2 ^ (3 ^ 2)". The factors are collected first and folded from the right,
+    // so a long chain does not nest the recursion; operands is shared by nested groups, each uses the part above base
+    bool power(NodeIndex& out) {
+        if (!factor(out))
+            return false;
+        std::size_t base = operands.size();
+        operands.push_back(out);
+        OpCode op;
+        while (operator_token({ OpCode::Power }, op)) {
+            std::size_t before = current++;
+            NodeIndex right;
+            if (!factor(right)) {
+                current = before;
+                break;
+            }
+            operands.push_back(right);
+        }
+        out = operands.back();
+        for (std::size_t i = operands.size() - 1; i-- > base;) {
+            if (!room()) {
+                operands.resize(base);
+                return false;
+            }
+            out = tree->binary(OpCode::Power, operands[i], out);
+        }
+        operands.resize(base);
+        return true;
+    }
+
+    bool factor(NodeIndex& out) {
+        const Token& token = tokens[current];
+        if (token.kind == Token::Open)
+            return group(out);
+        std::uint32_t slot;
+        if (token.kind == Token::Name) {
+            if (!room() || !resolve(token, slot))
+                return false;
+            out = tree->variable(slot);
+        } else if (token.kind == Token::Number) {
+            if (!room())
+                return false;
+            out = tree->constant(token.value);
+        } else {
+            return false;
+        }
+        ++current;
+        return true;
+    }
+
+    //Only groups nest the recursion, so bounding them keeps absurd inputs from running off the stack
+    bool group(NodeIndex& out) {
+        if (depth == max_nesting)
+            return exceeded(ParseStatus::TooDeep);
+        ++current;
+        ++depth;
+        bool closed = term(out) && tokens[current].kind == Token::Close;
+        --depth;
+        if (!closed)
+            return false;
+        ++current;
+        return true;
+    }
+
+    //Fails the parse with the first limit it went over, whatever the rules above would make of the failure
+    bool exceeded(ParseStatus limit) {
+        if (status == ParseStatus::Ok)
+            status = limit;
+        return false;
+    }
+
+    //True if one more Node stays within max_nodes
+    bool room() {
+        return tree->size() < max_nodes || exceeded(ParseStatus::TooManyNodes);
+    }
+
+    //Slot of the varname of a Name Token, false if it would be one variable too many for the SymbolTable
+    bool resolve(const Token& token, std::uint32_t& slot) {
+        return symbols->try_resolve(spelling(token), slot) || exceeded(ParseStatus::TooManyVariables);
+    }
+
+    //Varname of a Name Token, spaces inside it are dropped
+    const std::string& spelling(const Token& token) {
+        name.assign(text.data() + token.offset, token.length);
+        if (token.spaced)
+            name.erase(std::remove_if(name.begin(), name.end(), [](char c) { return chars::is(c, chars::Space); }),
+                       name.end());
+        return name;
+    }
+
+    Lexer lexer;
+    //limits() of the current parse and the first one it went over
+    std::size_t max_nodes = 0, max_nesting = 0;
+    ParseStatus status = ParseStatus::Ok;
+    std::string_view text;
+    const Token* tokens = nullptr;
+    std::size_t current = 0;
+    std::size_t depth = 0;
+    SyntaxTree* tree = nullptr;
+    SymbolTable* symbols = nullptr;
+    //Last spelled varname, reused so resolving does not allocate
+    std::string name;
+    //Factors of the open power rules, reused like name
+    std::vector<NodeIndex> operands;
+};
+#else
+
+// Phoenix lazy function to append a Node through the NodeBuilder, the attributes of the rules are NodeIndices
+template<OpCode Op>
+struct make_node_impl {
+    using result_type = NodeIndex;
+
+    template<typename ... Args>
+    NodeIndex operator()(const NodeBuilder& builder, const Args& ... args) const {
+        return builder.create<Op>(args ...);
+    }
+};
+
+template<OpCode Op>
+const phx::function<make_node_impl<Op>> make_node = make_node_impl<Op>();
+
+// Same for the factors of a power rule, joins them from the right into Power Nodes
+struct fold_power_impl {
+    using result_type = NodeIndex;
+
+    NodeIndex operator()(const NodeBuilder& builder, const std::vector<NodeIndex>& factors) const {
+        NodeIndex result = factors.back();
+        for (std::size_t i = factors.size() - 1; i-- > 0;)
+            result = builder.create<OpCode::Power>(factors[i], result);
+        return result;
+    }
+};
+
+const phx::function<fold_power_impl> fold_power = fold_power_impl();
+
+//Acutall Grammar, Iterator is the type of the input range it runs over
+template<typename Iterator>
+class ArithmeticGrammar : public qi::grammar<Iterator, NodeIndex(), qi::space_type> {
+public:
+    ArithmeticGrammar() : ArithmeticGrammar::base_type(start) {
+        //Say that varname equals alpha(character a-Z) or arbitrary number of alum(alphanumeric) i.E. it is possible to say var=42 and then use var
+        // %= is the most of the time equivalent of =, but needs to be %= this case as varname needs to be evaluated Later
+        varname %= qi::alpha >> *qi::alnum;
+
+        // _val is set through lambdas -> Placeholder for actual value later
+
+        // Start either has to be either varname (f.e. 'y=') and then Term or just Term;
+        // Also Assignment Operations are allowed like +=, -=, *= and /= 
+        start = assignment[qi::_val = qi::_1] | 
+                term[qi::_val = qi::_1];
+
+        // The varname is only parsed once and kept in a local, the operator then decides which Node gets built
+        // If no operator follows, only the varname is rolled back (no Node was allocated yet) and start falls back to term
+        assignment = varname[qi::_a = qi::_1] >> (
+                ('=' >> term)[qi::_val = make_node<OpCode::Assign>(phx::cref(builder), qi::_a, qi::_1)] |
+                (qi::lit("+=") >> term)[qi::_val = make_node<OpCode::AssignAdd>(phx::cref(builder), qi::_a, qi::_1)] |
+                (qi::lit("-=") >> term)[qi::_val = make_node<OpCode::AssignSubtract>(phx::cref(builder), qi::_a, qi::_1)] |
+                (qi::lit("*=") >> term)[qi::_val = make_node<OpCode::AssignMultiply>(phx::cref(builder), qi::_a, qi::_1)] |
+                (qi::lit("/=") >> term)[qi::_val = make_node<OpCode::AssignDivide>(phx::cref(builder), qi::_a, qi::_1)]);
+
+        // Term is a Product followed by any number of +/- Products
+        // Left-factored: the first Product is parsed exactly once and every further operand folds into _val,
+        // so nothing is re-parsed on a failed alternative and "a - b - c" becomes "(a - b) - c"
+        term = product[qi::_val = qi::_1] >> *(
+                ('+' >> product)[qi::_val = make_node<OpCode::Add>(phx::cref(builder), qi::_val, qi::_1)] |
+                ('-' >> product)[qi::_val = make_node<OpCode::Subtract>(phx::cref(builder), qi::_val, qi::_1)]);
+
+        // Product is a power followed by any number of */&&/|| powers, left associative the same way as term
+        product = power[qi::_val = qi::_1] >> *(
+                ('*' >> power)[qi::_val = make_node<OpCode::Multiply>(phx::cref(builder), qi::_val, qi::_1)] |
+                ('/' >> power)[qi::_val = make_node<OpCode::Divide>(phx::cref(builder), qi::_val, qi::_1)] |
+                (qi::lit("&&") >> power)[qi::_val = make_node<OpCode::And>(phx::cref(builder), qi::_val, qi::_1)] |
+                (qi::lit("||") >> power)[qi::_val = make_node<OpCode::Or>(phx::cref(builder), qi::_val, qi::_1)]);
+
+        // Power is a list of factors joined by ^, right associative: "2 ^ 3 ^ 2" is "2 ^ (3 ^ 2)"
+        // The list is folded after it was parsed, a long chain does not nest the rules
+        power = (factor % '^')[qi::_val = fold_power(phx::cref(builder), qi::_1)];
+
+        // Factor can be a group, a varname or just a regular int
+        factor = group[qi::_val = qi::_1] | 
+            varname[qi::_val = make_node<OpCode::PushVariable>(phx::cref(builder), qi::_1)] | 
+            qi::double_[qi::_val = make_node<OpCode::PushConstant>(phx::cref(builder), qi::_1)];
+
+        //Group is just Brackets with Term in Middle -> Needs to be evaluated later, Therefore has %=
+        group %= '(' >> term >> ')';
+    }
+
+    //SyntaxTree and SymbolTable of the semantic actions, set by the ParserSession for every parse
+    NodeBuilder builder;
+
+    //Uses Iterator to go over parsed string, store output in string and as a skipper the qi::space_type is expected
+    qi::rule<Iterator, std::string(), qi::space_type> varname;
+    //Same but stores the index of the Node in the SyntaxTree
+    qi::rule<Iterator, NodeIndex(), qi::space_type> start, term, group, product, power, factor;
+    //Assignment keeps the parsed varname in a local until it knows which operator follows
+    qi::rule<Iterator, NodeIndex(), qi::locals<std::string>, qi::space_type> assignment;
+};
+#endif
+
+//Slots of the variables and assignment targets of tree, each once in order of their first Node
+std::vector<std::uint32_t> used_slots(const SyntaxTree& tree) {
+    std::vector<std::uint32_t> slots;
+    for (std::size_t i = 0; i < tree.size(); ++i) {
+        const Node& node = tree[NodeIndex(i)];
+        if ((node.op == OpCode::PushVariable || is_assignment(node.op)) &&
+            std::find(slots.begin(), slots.end(), node.slot) == slots.end())
+            slots.push_back(node.slot);
+    }
+    return slots;
+}
+
+// LRU cache of compiled expressions, so an input that was seen before skips parsing and optimizing
+// Keys are the normalized source text, see normalize(). The memory of the entries is bounded by max_bytes
+// Programs refer to slots of the SymbolTable they were compiled against, so every entry remembers the names of its
+// slots and only hits for tables where those slots hold the same names (f.e. the per chunk copies of the Pipeline)
+// Constants were folded with their value at that time, an entry is only valid while they still have that value
+class ExpressionCache {
+public:
+    explicit ExpressionCache(std::size_t max_bytes = 4 << 20) : max_bytes(max_bytes) { }
+
+    ExpressionCache(const ExpressionCache&) = delete;
+    ExpressionCache& operator=(const ExpressionCache&) = delete;
+
+    //Drops the whitespace qi::space would skip, except where it separates two characters that would otherwise
+    //merge into one token ("1 2", "x + = 1", "1e -5"), so equal keys always parse the same way
+    static void normalize(std::string_view input, std::string& key) {
+        key.clear();
+        bool pending_space = false;
+        for (char c : input) {
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                pending_space = !key.empty();
+                continue;
+            }
+            if (pending_space && joins(key.back(), c))
+                key.push_back(' ');
+            pending_space = false;
+            key.push_back(c);
+        }
+    }
+
+    //Program for key if it is cached and valid for symbols, nullptr otherwise; counts the hit or miss
+    HotExpression* find(const std::string& key, SymbolTable& symbols) {
+        auto it = index.find(key);
+        if (it == index.end() || !matches(*it->second, symbols)) {
+            ++miss_count;
+            return nullptr;
+        }
+        ++hit_count;
+        entries.splice(entries.begin(), entries, it->second);
+        return &it->second->program;
+    }
+
+    //Same without counting and without touching the LRU order, f.e. to check which lines can share a Program
+    HotExpression* peek(const std::string& key, SymbolTable& symbols) {
+        auto it = index.find(key);
+        return it != index.end() && matches(*it->second, symbols) ? &it->second->program : nullptr;
+    }
+
+    //Optimizes and compiles the freshly parsed tree of key and adds (or replaces) its entry
+    //Evicts the least recently used entries to stay within max_bytes
+    HotExpression& insert(const std::string& key, SyntaxTree& tree, SymbolTable& symbols) {
+        auto existing = index.find(key);
+        if (existing != index.end())
+            erase(existing->second);
+
+        entries.emplace_front();
+        Entry& entry = entries.front();
+        entry.key = key;
+        // Every variable of the unoptimized tree, including the constants that are about to be folded
+        for (std::uint32_t slot : used_slots(tree))
+            entry.bindings.push_back({ slot, symbols.name(slot), symbols.is_constant(slot), symbols[slot] });
+        optimize(tree, symbols);
+        entry.program = HotExpression(compile(tree));
+
+        // The native code of an entry that turns hot lives in the JitArena and is not part of max_bytes
+        entry.bytes = sizeof(Entry) + entry.key.size() +
+                      entry.program.compiled().instructions().size() * sizeof(Instruction);
+        for (const Binding& binding : entry.bindings)
+            entry.bytes += sizeof(Binding) + binding.name.size();
+
+        index.emplace(std::string_view(entry.key), entries.begin());
+        used_bytes += entry.bytes;
+        // The new entry itself is kept even if it alone exceeds the budget, it is the first to go next time
+        while (used_bytes > max_bytes && entries.size() > 1)
+            erase(std::prev(entries.end()));
+        return entry.program;
+    }
+
+    std::size_t hits() const {
+        return hit_count;
+    }
+
+    std::size_t misses() const {
+        return miss_count;
+    }
+
+    std::size_t size() const {
+        return entries.size();
+    }
+
+    std::size_t bytes() const {
+        return used_bytes;
+    }
+
+private:
+    //A slot the Program depends on, value is only used for constants
+    struct Binding {
+        std::uint32_t slot;
+        std::string name;
+        bool constant;
+        double value;
+    };
+
+    struct Entry {
+        std::string key;
+        HotExpression program;
+        std::vector<Binding> bindings;
+        std::size_t bytes = 0;
+    };
+
+    //Characters that form one token together: numbers / varnames, "&&", "||" and the compound assignments
+    //A sign directly before a number belongs to it, "2*-1" is valid but "2*- 1" is not, so that space is kept as well
+    static bool joins(char left, char right) {
+        auto word = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '.'; };
+        return (word(left) && word(right)) ||
+               ((left == '+' || left == '-') && word(right)) ||
+               ((left == 'e' || left == 'E') && (right == '+' || right == '-')) ||
+               ((left == '&' || left == '|') && left == right) ||
+               (right == '=' && (left == '+' || left == '-' || left == '*' || left == '/'));
+    }
+
+    static bool matches(const Entry& entry, SymbolTable& symbols) {
+        for (const Binding& binding : entry.bindings) {
+            if (binding.slot >= symbols.size() || symbols.name(binding.slot) != binding.name)
+                return false;
+            // Same bits, so a folded -0 or NaN stays exactly what the Program computes with
+            if (binding.constant && (!symbols.is_constant(binding.slot) ||
+                                     std::memcmp(&binding.value, &symbols[binding.slot], sizeof(double)) != 0))
+                return false;
+        }
+        return true;
+    }
+
+    void erase(std::list<Entry>::iterator entry) {
+        used_bytes -= entry->bytes;
+        index.erase(std::string_view(entry->key));
+        entries.erase(entry);
+    }
+
+    std::size_t max_bytes, used_bytes = 0;
+    std::size_t hit_count = 0, miss_count = 0;
+    //Most recently used first, the index points into the list (its keys are views of the entry keys)
+    std::list<Entry> entries;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+};
+
+// Memory held for parsing in bytes, by what it is used for
+struct MemoryUsage {
+    //Nodes of the trees and Tokens of the lexer
+    std::size_t nodes = 0;
+    //Programs of the cache and the normalized source they are keyed by
+    std::size_t cache = 0;
+    //Names, values and index of a SymbolTable
+    std::size_t symbols = 0;
+
+    std::size_t total() const {
+        return nodes + cache + symbols;
+    }
+};
+
+// Owns one parser and parses any number of inputs with it -> the qi::rules and their semantic actions are built once, not per line
+class ParserSession {
+public:
+    //Parse one input into tree, replacing what it held before (a failed parse leaves an incomplete tree behind)
+    //Varnames are resolved to slots of symbols, the tree has to be evaluated with the values of that table
+    //The input is only viewed, no matter if it comes from a std::string, a chunk of the Pipeline or a mapped file
+    //Throws ParseError, or LimitExceeded for an input over the limits()
+    void parse(std::string_view input, SyntaxTree& tree, SymbolTable& symbols) {
+        tree.clear();
+        NodeBuilder builder;
+        builder.tree = &tree;
+        builder.symbols = &symbols;
+        NodeIndex root = 0;
+        try {
+#ifdef SIMPLEPARSER_USE_QI
+            if (nesting(input) > limits().max_nesting)
+                throw LimitExceeded(ParseStatus::TooDeep);
+            grammar.builder = builder;
+            // Pass input, Parser, skipper (space) and output-Node
+            PhraseParseOrDie(input.data(), input.data() + input.size(), grammar, qi::space, root);
+#else
+            root = parser.parse(input, builder);
+#endif
+        }
+        catch (const LimitExceeded&) {
+            SIMPLEPARSER_COUNT(limits_exceeded, 1);
+            account(tree, symbols);
+            throw;
+        }
+        tree.set_root(root);
+        account(tree, symbols);
+    }
+
+    //parse() without exceptions, for many lines in a row (see ParsedLines)
+    //For Failed unparsed is the offset of the rest of input the parser could not consume
+    ParseStatus try_parse(std::string_view input, SyntaxTree& tree, SymbolTable& symbols, std::size_t& unparsed) {
+        tree.clear();
+        NodeBuilder builder;
+        builder.tree = &tree;
+        builder.symbols = &symbols;
+        NodeIndex root = 0;
+#ifdef SIMPLEPARSER_USE_QI
+        if (nesting(input) > limits().max_nesting) {
+            SIMPLEPARSER_COUNT(limits_exceeded, 1);
+            return ParseStatus::TooDeep;
+        }
+        grammar.builder = builder;
+        const char* first = input.data();
+        bool ok;
+        // The semantic actions can only stop the grammar by throwing
+        try {
+            ok = qi::phrase_parse(first, input.data() + input.size(), grammar, qi::space, root);
+        }
+        catch (const LimitExceeded& e) {
+            SIMPLEPARSER_COUNT(limits_exceeded, 1);
+            account(tree, symbols);
+            return e.status;
+        }
+        // Like PhraseParseOrDie, the rest starts wherever the grammar left the iterator
+        unparsed = std::size_t(first - input.data());
+        ParseStatus status = ok && unparsed == input.size() ? ParseStatus::Ok : ParseStatus::Failed;
+#else
+        ParseStatus status = parser.try_parse(input, builder, root, unparsed);
+#endif
+        if (status != ParseStatus::Ok && status != ParseStatus::Failed)
+            SIMPLEPARSER_COUNT(limits_exceeded, 1);
+        tree.set_root(root);
+        account(tree, symbols);
+        return status;
+    }
+
+    //Memory this session holds: its Tokens and scratch tree (plus the one it parsed into last), its cached Programs
+    //and the SymbolTable it parsed against last
+    MemoryUsage memory() const {
+        MemoryUsage usage = last;
+        usage.cache = expressions.bytes() + key.capacity();
+        return usage;
+    }
+
+    //One Session per thread, so every worker reuses its own parser instead of sharing one across threads
+    static ParserSession& local() {
+        thread_local ParserSession session;
+        return session;
+    }
+
+    //Reusable tree for the one-expression-at-a-time case
+    SyntaxTree& scratch_tree() {
+        return scratch;
+    }
+
+    //Programs of the inputs this thread has already seen, key is a reusable buffer for ExpressionCache::normalize()
+    ExpressionCache& cache() {
+        return expressions;
+    }
+
+    std::string& cache_key() {
+        return key;
+    }
+
+private:
+#ifdef SIMPLEPARSER_USE_QI
+    //Deepest nesting of parentheses in input, no group of it can be nested deeper
+    static std::size_t nesting(std::string_view input) {
+        std::size_t depth = 0, deepest = 0;
+        for (char c : input) {
+            if (c == '(')
+                deepest = std::max(deepest, ++depth);
+            else if (c == ')' && depth > 0)
+                --depth;
+        }
+        return deepest;
+    }
+#endif
+
+    //Updates memory() after a parse into tree against symbols and records the peaks (STATS)
+    void account(const SyntaxTree& tree, const SymbolTable& symbols) {
+#ifdef SIMPLEPARSER_USE_QI
+        last.nodes = scratch.bytes();
+#else
+        last.nodes = parser.bytes() + scratch.bytes();
+#endif
+        if (&tree != &scratch)
+            last.nodes += tree.bytes();
+        last.symbols = symbols.bytes();
+        SIMPLEPARSER_PEAK(peak_expression_nodes, tree.size());
+        SIMPLEPARSER_PEAK(peak_node_bytes, last.nodes);
+        SIMPLEPARSER_PEAK(peak_cache_bytes, expressions.bytes() + key.capacity());
+        SIMPLEPARSER_PEAK(peak_symbol_bytes, last.symbols);
+    }
+
+#ifdef SIMPLEPARSER_USE_QI
+    ArithmeticGrammar<const char*> grammar;
+#else
+    ExpressionParser parser;
+#endif
+    SyntaxTree scratch;
+    ExpressionCache expressions;
+    std::string key;
+    MemoryUsage last;
+};
+
+/******************************************************************************/
+
+#ifdef SIMPLEPARSER_MMAP
+// Read only mapping of a whole file, its lines are parsed right where the kernel put them instead of being copied
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat " + path);
+        }
+        length = static_cast<std::size_t>(info.st_size);
+        // Empty files can not be mapped, they just have no lines
+        void* memory = length > 0 ? ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        // The mapping keeps the file alive on its own
+        ::close(fd);
+        if (memory == MAP_FAILED)
+            throw std::runtime_error("Cannot map " + path);
+        if (memory)
+            ::madvise(memory, length, MADV_SEQUENTIAL);
+        bytes = static_cast<const char*>(memory);
+    }
+
+    ~MappedFile() {
+        if (bytes)
+            ::munmap(const_cast<char*>(bytes), length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* begin() const {
+        return bytes;
+    }
+
+    const char* end() const {
+        return bytes + length;
+    }
+
+private:
+    const char* bytes = nullptr;
+    std::size_t length = 0;
+};
+
+// Compiled expressions in a binary file that is mapped and run in place, so a restart does not parse them again
+// Layout in native byte order, every section starts 8 byte aligned at the offset given in the Header:
+//   Instructions   all Programs back to back, in the memory layout of CompiledExpression (padding zeroed)
+//   Expressions    one record per Program, sorted by key: its Instructions, stack size, key and Bindings
+//   Bindings       per Program the symbols it uses, folded constants with the value they were folded with
+//   Symbols        names of the SymbolTable the Programs were compiled against in slot order, values and constness
+//   Strings        the keys (normalized source text, see ExpressionCache::normalize()) and names
+// Loading resolves the names in a SymbolTable. If they get the slots they had when compiling, f.e. because both start
+// from the same variables, the Programs run straight from the mapping, otherwise the Instructions are copied once
+// with the new slots. Like for the ExpressionCache a Program only hits for tables where its constants are unchanged
+class CompiledLibrary {
+    // File layout, see above. Every record has a size that keeps the next one aligned
+    static constexpr char magic[8] = { 'S', 'P', 'L', 'I', 'B', 'R', 'A', 'R' };
+    static constexpr std::uint32_t byte_order = 0x01020304;
+
+    struct Section {
+        std::uint64_t offset, count;
+    };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version, byte_order, instruction_size, reserved;
+        Section instructions, expressions, bindings, symbols, strings;
+    };
+
+    struct ExpressionRecord {
+        std::uint64_t first_instruction;
+        std::uint32_t instruction_count, stack_size;
+        std::uint32_t key_offset, key_length;
+        std::uint32_t first_binding, binding_count;
+    };
+
+    struct BindingRecord {
+        std::uint32_t symbol, constant;
+        double value;
+    };
+
+    struct SymbolRecord {
+        std::uint32_t name_offset, name_length, constant, reserved;
+        double value;
+    };
+
+public:
+    //2: Jumps for && / ||, the OpCodes of the Assignments moved
+    static constexpr std::uint32_t format_version = 2;
+
+    // Compiles expressions and writes them as a CompiledLibrary file
+    class Writer {
+    public:
+        //Parses, optimizes and compiles source against symbols (throws ParseError); an expression with the same
+        //normalized text as an earlier one is skipped (returns false). All sources need to use the same table
+        bool add(std::string_view source, SymbolTable& symbols) {
+            std::string key;
+            ExpressionCache::normalize(source, key);
+            if (expressions.count(key))
+                return false;
+            SyntaxTree tree;
+            ParserSession::local().parse(source, tree, symbols);
+            Expression expression;
+            expression.slots = used_slots(tree);
+            optimize(tree, symbols);
+            expression.program = compile(tree);
+            expressions.emplace(std::move(key), std::move(expression));
+            return true;
+        }
+
+        //symbols is the table passed to add() and gets saved along with the Programs, throws if writing fails
+        void write(const std::string& path, const SymbolTable& symbols) const {
+            std::string strings;
+            std::vector<Instruction> instructions;
+            std::vector<ExpressionRecord> records;
+            std::vector<BindingRecord> bindings;
+            for (const auto& [key, expression] : expressions) {
+                ExpressionRecord record{};
+                record.first_instruction = instructions.size();
+                record.instruction_count = std::uint32_t(expression.program.instructions().size());
+                record.stack_size = std::uint32_t(expression.program.stack_size());
+                record.key_offset = std::uint32_t(strings.size());
+                record.key_length = std::uint32_t(key.size());
+                record.first_binding = std::uint32_t(bindings.size());
+                record.binding_count = std::uint32_t(expression.slots.size());
+                strings += key;
+                for (const Instruction& instruction : expression.program.instructions()) {
+                    // Written field by field, so the padding bytes are zero instead of whatever the stack held
+                    Instruction copy;
+                    std::memset(&copy, 0, sizeof(copy));
+                    copy.op = instruction.op;
+                    copy.variable = instruction.variable;
+                    copy.constant = instruction.constant;
+                    instructions.push_back(copy);
+                }
+                for (std::uint32_t slot : expression.slots) {
+                    bool constant = symbols.is_constant(slot);
+                    bindings.push_back({ slot, constant, constant ? symbols[slot] : 0.0 });
+                }
+                records.push_back(record);
+            }
+            std::vector<SymbolRecord> names;
+            for (std::uint32_t slot = 0; slot < symbols.size(); ++slot) {
+                names.push_back({ std::uint32_t(strings.size()), std::uint32_t(symbols.name(slot).size()),
+                                  symbols.is_constant(slot), 0, symbols[slot] });
+                strings += symbols.name(slot);
+            }
+
+            Header header{};
+            std::memcpy(header.magic, magic, sizeof(header.magic));
+            header.version = format_version;
+            header.byte_order = byte_order;
+            header.instruction_size = sizeof(Instruction);
+            std::string file(sizeof(Header), '\0');
+            header.instructions = append(file, instructions);
+            header.expressions = append(file, records);
+            header.bindings = append(file, bindings);
+            header.symbols = append(file, names);
+            header.strings = append(file, std::vector<char>(strings.begin(), strings.end()));
+            std::memcpy(&file[0], &header, sizeof(header));
+
+            std::FILE* out = std::fopen(path.c_str(), "wb");
+            bool written = out && std::fwrite(file.data(), 1, file.size(), out) == file.size();
+            if (out && std::fclose(out) != 0)
+                written = false;
+            if (!written)
+                throw std::runtime_error("Cannot write " + path);
+        }
+
+        std::size_t size() const {
+            return expressions.size();
+        }
+
+    private:
+        struct Expression {
+            CompiledExpression program;
+            std::vector<std::uint32_t> slots;
+        };
+
+        template<typename Record>
+        static Section append(std::string& file, const std::vector<Record>& records) {
+            file.resize((file.size() + 7) / 8 * 8, '\0');
+            Section section{ file.size(), records.size() };
+            file.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+            return section;
+        }
+
+        //Sorted by key, so the library can binary search its records
+        std::map<std::string, Expression> expressions;
+    };
+
+    //Maps the file and checks it completely, a damaged or foreign file throws std::runtime_error instead of being run
+    explicit CompiledLibrary(const std::string& path) : file(path) {
+        const char* base = file.begin();
+        std::size_t length = std::size_t(file.end() - file.begin());
+        if (length < sizeof(Header))
+            throw std::runtime_error(path + " is no compiled library");
+        std::memcpy(&header, base, sizeof(header));
+        if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0)
+            throw std::runtime_error(path + " is no compiled library");
+        if (header.version != format_version)
+            throw std::runtime_error(path + " has format version " + std::to_string(header.version) + ", expected " +
+                                     std::to_string(format_version));
+        if (header.byte_order != byte_order || header.instruction_size != sizeof(Instruction))
+            throw std::runtime_error(path + " was written on an incompatible platform");
+
+        instructions = section<Instruction>(header.instructions, length, path);
+        records = section<ExpressionRecord>(header.expressions, length, path);
+        bindings = section<BindingRecord>(header.bindings, length, path);
+        symbols = section<SymbolRecord>(header.symbols, length, path);
+        strings = section<char>(header.strings, length, path);
+        validate(path);
+    }
+
+    CompiledLibrary(const CompiledLibrary&) = delete;
+    CompiledLibrary& operator=(const CompiledLibrary&) = delete;
+
+    //Resolves the names of the library in table (new ones get their saved value and constness) and prepares the
+    //Programs for its slots, lookups are then valid for table and all its copies
+    void bind(SymbolTable& table) {
+        slots.resize(header.symbols.count);
+        bool moved = false;
+        for (std::uint32_t symbol = 0; symbol < slots.size(); ++symbol) {
+            std::size_t known = table.size();
+            slots[symbol] = table.resolve(std::string(name(symbol)));
+            if (table.size() != known) {
+                table[slots[symbol]] = symbols[symbol].value;
+                table.set_constant(slots[symbol], symbols[symbol].constant != 0);
+            }
+            moved = moved || slots[symbol] != symbol;
+        }
+
+        const Instruction* code = instructions;
+        if (moved) {
+            remapped.assign(instructions, instructions + header.instructions.count);
+            for (Instruction& instruction : remapped)
+                if (instruction.op == OpCode::PushVariable || is_assignment(instruction.op))
+                    instruction.variable = slots[instruction.variable];
+            code = remapped.data();
+        }
+        programs.clear();
+        programs.reserve(header.expressions.count);
+        for (std::size_t i = 0; i < header.expressions.count; ++i)
+            programs.push_back(CompiledExpression::view(code + records[i].first_instruction,
+                                                        records[i].instruction_count, records[i].stack_size));
+    }
+
+    //Program of key if the library has one that is valid for table (same names at its slots, constants unchanged)
+    const CompiledExpression* find(std::string_view key, SymbolTable& table) const {
+        const ExpressionRecord* first = records;
+        const ExpressionRecord* last = records + programs.size();
+        const ExpressionRecord* record = std::lower_bound(first, last, key, [this](const ExpressionRecord& lhs,
+                                                                                  std::string_view rhs) {
+            return text(lhs.key_offset, lhs.key_length) < rhs;
+        });
+        if (record == last || text(record->key_offset, record->key_length) != key)
+            return nullptr;
+        for (std::uint32_t i = 0; i < record->binding_count; ++i) {
+            const BindingRecord& binding = bindings[record->first_binding + i];
+            std::uint32_t slot = slots[binding.symbol];
+            if (slot >= table.size() || table.name(slot) != name(binding.symbol))
+                return nullptr;
+            if (binding.constant && (!table.is_constant(slot) ||
+                                     std::memcmp(&binding.value, &table[slot], sizeof(double)) != 0))
+                return nullptr;
+        }
+        return &programs[std::size_t(record - first)];
+    }
+
+    std::size_t size() const {
+        return header.expressions.count;
+    }
+
+    //Library testGrammar() looks into after the ExpressionCache, set before any thread uses it (by a Worker per job)
+    static const CompiledLibrary*& installed() {
+        static const CompiledLibrary* library = nullptr;
+        return library;
+    }
+
+private:
+    template<typename Record>
+    const Record* section(const Section& section, std::size_t length, const std::string& path) const {
+        if (section.offset % alignof(Record) != 0 || section.offset > length ||
+            section.count > (length - section.offset) / sizeof(Record))
+            throw std::runtime_error(path + " is truncated or damaged");
+        return reinterpret_cast<const Record*>(file.begin() + section.offset);
+    }
+
+    //Every index points into its section and every Program leaves exactly one value on a stack of its stack size
+    void validate(const std::string& path) const {
+        auto check = [&path](bool valid) {
+            if (!valid)
+                throw std::runtime_error(path + " is truncated or damaged");
+        };
+        for (std::size_t i = 0; i < header.symbols.count; ++i)
+            check(std::uint64_t(symbols[i].name_offset) + symbols[i].name_length <= header.strings.count);
+        for (std::size_t i = 0; i < header.bindings.count; ++i)
+            check(bindings[i].symbol < header.symbols.count);
+        for (std::size_t i = 0; i < header.expressions.count; ++i) {
+            const ExpressionRecord& record = records[i];
+            check(std::uint64_t(record.key_offset) + record.key_length <= header.strings.count);
+            check(std::uint64_t(record.first_binding) + record.binding_count <= header.bindings.count);
+            check(record.first_instruction + record.instruction_count <= header.instructions.count);
+            check(i == 0 || text(records[i - 1].key_offset, records[i - 1].key_length) <
+                            text(record.key_offset, record.key_length));
+            // A Jump has to skip exactly to its And / Or, nested inside the right operand of any open one, and the
+            // stack has to be as deep there as it would be with the right operand. Open ones: (And / Or, depth there)
+            std::size_t depth = 0, deepest = 0;
+            std::vector<std::pair<std::uint64_t, std::size_t>> jumps;
+            for (std::uint32_t k = 0; k < record.instruction_count; ++k) {
+                const Instruction& instruction = instructions[record.first_instruction + k];
+                check(instruction.op <= OpCode::AssignDivide);
+                if (!jumps.empty() && jumps.back().first == k) {
+                    check(depth == jumps.back().second);
+                    jumps.pop_back();
+                }
+                if (instruction.op == OpCode::PushConstant || instruction.op == OpCode::PushVariable) {
+                    deepest = std::max(deepest, ++depth);
+                } else if (instruction.op == OpCode::JumpIfFalse || instruction.op == OpCode::JumpIfTrue) {
+                    std::uint64_t target = std::uint64_t(k) + instruction.variable;
+                    check(depth >= 1 && instruction.variable >= 1 && target < record.instruction_count);
+                    check(jumps.empty() || target < jumps.back().first);
+                    OpCode matching = instruction.op == OpCode::JumpIfFalse ? OpCode::And : OpCode::Or;
+                    check(instructions[record.first_instruction + target].op == matching);
+                    jumps.push_back({ target, depth + 1 });
+                } else if (!is_assignment(instruction.op)) {
+                    check(depth-- >= 2);
+                } else {
+                    check(depth >= 1);
+                }
+                if (instruction.op == OpCode::PushVariable || is_assignment(instruction.op))
+                    check(instruction.variable < header.symbols.count);
+            }
+            check(depth == 1 && deepest == record.stack_size && jumps.empty());
+        }
+    }
+
+    std::string_view text(std::uint32_t offset, std::uint32_t length) const {
+        return std::string_view(strings + offset, length);
+    }
+
+    std::string_view name(std::uint32_t symbol) const {
+        return text(symbols[symbol].name_offset, symbols[symbol].name_length);
+    }
+
+    MappedFile file;
+    Header header;
+    const Instruction* instructions = nullptr;
+    const ExpressionRecord* records = nullptr;
+    const BindingRecord* bindings = nullptr;
+    const SymbolRecord* symbols = nullptr;
+    const char* strings = nullptr;
+    //Slot in the bound SymbolTable per symbol of the file, Instructions with those slots if they differ
+    std::vector<std::uint32_t> slots;
+    std::vector<Instruction> remapped;
+    std::vector<CompiledExpression> programs;
+};
+#endif
+
+/******************************************************************************/
+
+// Output of the evaluated lines, the format is chosen once at startup and shared by all modes
+//   Text    "evaluate() = 6.28319" like printf("%g"), errors with the unparsed rest of the line
+//   Csv     "value,error,unparsed" rows, values in the shortest form that reads back to the same double
+//   Binary  one ResultRecord per line in native byte order, f.e. to map the output into another process
+enum class OutputFormat { Text, Csv, Binary };
+
+struct ResultRecord {
+    //Status of a line
+    enum : std::uint32_t { Ok, ParseFailed, Failed };
+
+    double value;
+    std::uint32_t status, reserved;
+};
+
+static_assert(sizeof(ResultRecord) == 16, "Records are written as raw memory");
+
+//Set before any output: from the command line, by a Worker from every job before the threads of that job start
+OutputFormat& output_format() {
+    static OutputFormat format = OutputFormat::Text;
+    return format;
+}
+
+//Format of a command line name (text, csv or binary)
+std::optional<OutputFormat> output_format_named(std::string_view name) {
+    if (name == "text")
+        return OutputFormat::Text;
+    if (name == "csv")
+        return OutputFormat::Csv;
+    if (name == "binary")
+        return OutputFormat::Binary;
+    return std::nullopt;
+}
+
+//Header line of the format, empty for the ones without
+std::string_view output_header() {
+    return output_format() == OutputFormat::Csv ? "value,error,unparsed\n" : "";
+}
+
+// to_chars instead of the locale aware iostream formatting, written with a single write()
+void print_result(std::ostream& out, double value) {
+    char buffer[64];
+    char* last = buffer;
+    if (output_format() == OutputFormat::Binary) {
+        ResultRecord record{ value, ResultRecord::Ok, 0 };
+        out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        return;
+    }
+    if (output_format() == OutputFormat::Text) {
+        std::memcpy(buffer, "evaluate() = ", 13);
+        last = std::to_chars(buffer + 13, buffer + sizeof(buffer) - 2, value, std::chars_format::general, 6).ptr;
+    } else {
+        last = std::to_chars(buffer, buffer + sizeof(buffer) - 2, value).ptr;
+        *last++ = ',';
+        *last++ = ',';
+    }
+    *last++ = '\n';
+    out.write(buffer, last - buffer);
+}
+
+//CSV field in quotes, quotes inside doubled
+void print_csv_field(std::ostream& out, std::string_view text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"')
+            out << '"';
+        out << c;
+    }
+    out << '"';
+}
+
+//Error of a line, unparsed is only there for parse errors and holds the rest of the line the parser could not consume
+void print_error(std::ostream& out, const char* what, std::optional<std::string_view> unparsed) {
+    if (output_format() == OutputFormat::Binary) {
+        ResultRecord record{ std::numeric_limits<double>::quiet_NaN(),
+                             unparsed ? ResultRecord::ParseFailed : ResultRecord::Failed, 0 };
+        out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    } else if (output_format() == OutputFormat::Csv) {
+        out << ',';
+        print_csv_field(out, what);
+        out << ',';
+        if (unparsed)
+            print_csv_field(out, *unparsed);
+        out << '\n';
+    } else {
+        if (unparsed)
+            out << "Unparseable: " << std::quoted(*unparsed) << '\n';
+        out << "EXCEPTION was THROWN: " << what << '\n';
+    }
+}
+
+void print_error(std::ostream& out, const std::exception& e) {
+    std::optional<std::string_view> unparsed;
+    if (const ParseError* parse_error = dynamic_cast<const ParseError*>(&e))
+        unparsed = parse_error->unparsed;
+    print_error(out, e.what(), unparsed);
+}
+
+//Flushes out once in has nothing more waiting: a file or pipe gets large writes, an interactive user every answer
+//(needs std::ios::sync_with_stdio(false) for std::cin, otherwise it never knows about waiting input)
+void flush_when_idle(std::istream& in, std::ostream& out) {
+    if (in.rdbuf()->in_avail() <= 0)
+        SIMPLEPARSER_TIMED(Output, out.flush());
+}
+
+// Large buffer in place of the one of a stream (f.e. std::cout), written to file with one fwrite per buffer_size
+// bytes instead of one per line. flush() still writes right away, the old buffer is put back on destruction
+class OutputBuffer : public std::streambuf {
+public:
+    static constexpr std::size_t buffer_size = 1 << 16;
+
+    OutputBuffer(std::ostream& stream, std::FILE* file) : stream(stream), file(file), buffer(buffer_size) {
+        setp(buffer.data(), buffer.data() + buffer.size());
+        previous = stream.rdbuf(this);
+    }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    ~OutputBuffer() override {
+        sync();
+        stream.rdbuf(previous);
+    }
+
+protected:
+    int overflow(int c) override {
+        if (!write())
+            return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        return write() && std::fflush(file) == 0 ? 0 : -1;
+    }
+
+private:
+    bool write() {
+        std::size_t size = std::size_t(pptr() - pbase());
+        setp(buffer.data(), buffer.data() + buffer.size());
+        return std::fwrite(buffer.data(), 1, size, file) == size;
+    }
+
+    std::ostream& stream;
+    std::FILE* file;
+    std::vector<char> buffer;
+    std::streambuf* previous = nullptr;
+};
+
+//Parses and evaluates one line against symbols and writes the result (or the error) to out
+//Lines seen before are taken from the cache of the session, only their Program runs
+void testGrammar(std::string_view input, SymbolTable& symbols, std::ostream& out) {
+    ParserSession& session = ParserSession::local();
+    std::string& key = session.cache_key();
+    SIMPLEPARSER_COUNT(expressions, 1);
+    HotExpression* hot = SIMPLEPARSER_TIMED(CacheLookup, ExpressionCache::normalize(input, key),
+                                            session.cache().find(key, symbols));
+    const CompiledExpression* cached = hot ? &hot->compiled() : nullptr;
+#ifdef SIMPLEPARSER_MMAP
+    if (!cached && CompiledLibrary::installed())
+        cached = SIMPLEPARSER_TIMED(CacheLookup, CompiledLibrary::installed()->find(key, symbols));
+#endif
+    if (cached) {
+        SIMPLEPARSER_COUNT(cache_hits, 1);
+        // Library Programs stay in the interpreter, they are run in place from the mapping
+        double value = SIMPLEPARSER_TIMED(Evaluate, hot ? hot->evaluate(symbols.data())
+                                                        : cached->evaluate(symbols.data()));
+        SIMPLEPARSER_TIMED(Output, print_result(out, value));
+        return;
+    }
+    SIMPLEPARSER_COUNT(cache_misses, 1);
+
+    SyntaxTree& tree = session.scratch_tree();
+    try {
+        SIMPLEPARSER_TIMED(Parse, session.parse(input, tree, symbols));
+        SIMPLEPARSER_COUNT(nodes, tree.size());
+
+        HotExpression& program = SIMPLEPARSER_TIMED(Optimize, session.cache().insert(key, tree, symbols));
+        double value = SIMPLEPARSER_TIMED(Evaluate, program.evaluate(symbols.data()));
+        SIMPLEPARSER_TIMED(Output, print_result(out, value));
+    }
+    catch (std::exception& e) {
+        SIMPLEPARSER_COUNT(errors, 1);
+        SIMPLEPARSER_TIMED(Output, print_error(out, e));
+    }
+}
+
+/******************************************************************************/
+
+// Many expressions parsed with one call: a buffer of newline separated lines (f.e. a chunk or a mapped file) becomes
+// one stream of Instructions and an offsets table telling where in it the Program of every line is
+// Nothing throws, every line gets a status instead, a line that does not parse keeps the offset of its unparsed rest
+// and a line over the limits() is reported as such
+// One tree, one Program and one stream serve all lines, so once they have grown parsing a batch allocates nothing
+// Lines are optimized while parsing, which folds constants with their value at that time. Like in ExpressionDag a line
+// assigning to a constant therefore ends the batch, the lines after it are parsed once it has been evaluated
+// Given an ExpressionCache every line is looked up first and only the misses are parsed, a hit ends the batch and runs
+// as the HotExpression of its entry, which stays valid as long as nothing is inserted after it. A miss is only added to
+// the cache when it is seen the second time, so lines that never come back do not pay for an entry, and while less
+// than a quarter of the lookups hit only every sample_every-th line is looked up to notice when that changes
+class ParsedLines {
+public:
+    using Status = ParseStatus;
+
+    //Line in the buffer, its Program in the stream and for Failed the start of the unparsed rest in the line
+    struct Offsets {
+        std::uint32_t line, length;
+        std::uint32_t first, count, stack_size;
+        std::uint32_t unparsed;
+    };
+
+    //Lines of a batch in run_lines(), bounds the memory of the stream for large inputs
+    static constexpr std::size_t batch_lines = 1 << 16;
+
+    //Hashes of missed keys remembered to recognize the second sighting, colliding keys replace each other
+    static constexpr std::size_t seen_slots = 1 << 16;
+
+    //Lookups whose hit rate decides between looking up every line or only every sample_every-th
+    static constexpr std::size_t sample_window = 1024, sample_every = 16;
+
+    //Offsets are 32 bit, a larger buffer is parsed in several batches
+    static constexpr std::size_t max_bytes = std::numeric_limits<std::uint32_t>::max();
+
+    //Parses the lines at the start of buffer instead of the ones before, returns the number of bytes it consumed
+    //That is all of buffer unless a line assigns to a constant, hits the cache or max_lines lines are reached.
+    //Varnames are resolved to slots of symbols, the Programs have to be evaluated with the values of that table
+    std::size_t parse(std::string_view buffer, SymbolTable& symbols,
+                      std::size_t max_lines = std::numeric_limits<std::size_t>::max(),
+                      ExpressionCache* cache = nullptr) {
+        text = buffer;
+        table.clear();
+        status_array.clear();
+        stream.clear();
+        hit = nullptr;
+        ParserSession& session = ParserSession::local();
+        const char* first = buffer.data();
+        const char* last = first + buffer.size();
+        const char* line = first;
+        while (line != last && table.size() < max_lines) {
+            const char* newline = static_cast<const char*>(std::memchr(line, '\n', last - line));
+            const char* line_end = newline ? newline : last;
+            if (std::size_t(line_end - first) > max_bytes)
+                break;
+            Offsets entry{ std::uint32_t(line - first), std::uint32_t(line_end - line), std::uint32_t(stream.size()),
+                           0, 0, 0 };
+            line = newline ? newline + 1 : last;
+
+            SIMPLEPARSER_COUNT(expressions, 1);
+            std::string_view source(first + entry.line, entry.length);
+            bool admit = false;
+            if (cache && sampled()) {
+                std::string& key = session.cache_key();
+                hit = SIMPLEPARSER_TIMED(CacheLookup, ExpressionCache::normalize(source, key),
+                                         cache->find(key, symbols));
+                record(hit != nullptr);
+                if (hit) {
+                    SIMPLEPARSER_COUNT(cache_hits, 1);
+                    table.push_back(entry);
+                    status_array.push_back(Status::Ok);
+                    break;
+                }
+                SIMPLEPARSER_COUNT(cache_misses, 1);
+                if (seen.empty())
+                    seen.resize(seen_slots);
+                std::size_t hash = std::hash<std::string>()(key);
+                std::size_t& slot = seen[hash % seen_slots];
+                admit = slot == hash;
+                slot = hash;
+            }
+            std::size_t unparsed = 0;
+            Status status = SIMPLEPARSER_TIMED(Parse, session.try_parse(source, tree, symbols, unparsed));
+            if (status != Status::Ok) {
+                SIMPLEPARSER_COUNT(errors, 1);
+                entry.unparsed = std::uint32_t(unparsed);
+                table.push_back(entry);
+                status_array.push_back(status);
+                continue;
+            }
+            SIMPLEPARSER_COUNT(nodes, tree.size());
+            // An entry inserted now can be evicted by a later line of the batch, so its Program is copied as well
+            const CompiledExpression& line_program = admit
+                ? SIMPLEPARSER_TIMED(Optimize, cache->insert(session.cache_key(), tree, symbols)).compiled()
+                : SIMPLEPARSER_TIMED(Optimize, optimize(tree, symbols), compiled.clear(), compile(tree, compiled),
+                                     compiled);
+            InstructionRange code = line_program.instructions();
+            stream.insert(stream.end(), code.begin(), code.end());
+            entry.count = std::uint32_t(code.size());
+            entry.stack_size = std::uint32_t(line_program.stack_size());
+            table.push_back(entry);
+            status_array.push_back(Status::Ok);
+
+            const Node& root = tree[tree.root()];
+            if (is_assignment(root.op) && symbols.is_constant(root.slot))
+                break;
+        }
+        return std::size_t(line - first);
+    }
+
+    //Evaluates the lines in order against symbols and writes exactly what testGrammar() writes for them
+    void run(SymbolTable& symbols, std::ostream& out) const {
+        for (std::size_t i = 0; i < size(); ++i) {
+            if (status_array[i] == Status::Failed) {
+                SIMPLEPARSER_TIMED(Output, print_error(out, ParseError::message, unparsed(i)));
+                continue;
+            }
+            if (status_array[i] != Status::Ok) {
+                SIMPLEPARSER_TIMED(Output, print_error(out, limit_message(status_array[i]).c_str(), std::nullopt));
+                continue;
+            }
+            double value = SIMPLEPARSER_TIMED(Evaluate, hit && i + 1 == size() ? hit->evaluate(symbols.data())
+                                                                                : program(i).evaluate(symbols.data()));
+            SIMPLEPARSER_TIMED(Output, print_result(out, value));
+        }
+    }
+
+    std::size_t size() const {
+        return table.size();
+    }
+
+    const std::vector<Offsets>& offsets() const {
+        return table;
+    }
+
+    const std::vector<Status>& statuses() const {
+        return status_array;
+    }
+
+    std::string_view line(std::size_t i) const {
+        return text.substr(table[i].line, table[i].length);
+    }
+
+    //Rest of a Failed line the parser could not consume
+    std::string_view unparsed(std::size_t i) const {
+        return line(i).substr(table[i].unparsed);
+    }
+
+    //Program of an Ok line, a view into the stream that stays valid until the next parse()
+    //Empty for the last line when it was a cache hit(), that one runs as the HotExpression in the cache
+    CompiledExpression program(std::size_t i) const {
+        return CompiledExpression::view(stream.data() + table[i].first, table[i].count, table[i].stack_size);
+    }
+
+    //Instructions of all Ok lines one after another
+    const std::vector<Instruction>& instructions() const {
+        return stream;
+    }
+
+    //Cache entry of the last line if the batch ended because the cache had it, nullptr otherwise
+    HotExpression* cache_hit() const {
+        return hit;
+    }
+
+private:
+    //Whether the next line is looked up in the cache
+    bool sampled() {
+        return !sampling || ++skipped % sample_every == 0;
+    }
+
+    //Counts a lookup, after sample_window of them their hit rate decides whether to sample from now on
+    void record(bool is_hit) {
+        window_hits += is_hit;
+        if (++window_lookups < sample_window)
+            return;
+        sampling = window_hits * 4 < window_lookups;
+        window_lookups = window_hits = 0;
+    }
+
+    std::string_view text;
+    std::vector<Offsets> table;
+    std::vector<Status> status_array;
+    std::vector<Instruction> stream;
+    SyntaxTree tree;
+    CompiledExpression compiled;
+    HotExpression* hit = nullptr;
+    std::vector<std::size_t> seen;
+    std::size_t window_lookups = 0, window_hits = 0, skipped = 0;
+    bool sampling = false;
+};
+
+//Runs the newline separated lines of text against symbols and writes what testGrammar() writes for each of them
+//Like testGrammar() every line is looked up in the session cache first, lines behind a hit run as its HotExpression,
+//the misses are parsed by lines in batches. With a CompiledLibrary installed they go through testGrammar() one by one
+void run_lines(std::string_view text, SymbolTable& symbols, std::ostream& out, ParsedLines& lines) {
+#ifdef SIMPLEPARSER_MMAP
+    if (CompiledLibrary::installed()) {
+        while (!text.empty()) {
+            std::size_t end = std::min(text.find('\n'), text.size());
+            testGrammar(text.substr(0, end), symbols, out);
+            text.remove_prefix(std::min(end + 1, text.size()));
+        }
+        return;
+    }
+#endif
+    ExpressionCache& cache = ParserSession::local().cache();
+    while (!text.empty()) {
+        text.remove_prefix(lines.parse(text, symbols, ParsedLines::batch_lines, &cache));
+        lines.run(symbols, out);
+    }
+}
+
+/******************************************************************************/
+
+// Minimal bounded queue for handing work between the pipeline threads
+// push() blocks while the queue is full, pop() returns nothing once the queue is closed and drained
+template<typename T>
+class BlockingQueue {
+public:
+    explicit BlockingQueue(std::size_t capacity) : capacity(capacity) { }
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty())
+            return std::nullopt;
+        T item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return item;
+    }
+
+    //No more pushes, waiting consumers wake up once everything is popped
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    std::size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+};
+
+//Splits input into chunks of whole lines of about chunk_size bytes and hands them to submit(std::string) in order,
+//until the end of input or until submit returns false
+template<typename Submit>
+void read_chunks(std::FILE* input, std::size_t chunk_size, Submit submit) {
+    std::string pending;
+    std::vector<char> buffer(chunk_size);
+    std::size_t count;
+    while ((count = std::fread(buffer.data(), 1, buffer.size(), input)) > 0) {
+        pending.append(buffer.data(), count);
+        std::size_t last_newline = pending.rfind('\n');
+        if (last_newline == std::string::npos)
+            continue;
+        if (!submit(pending.substr(0, last_newline + 1)))
+            return;
+        pending.erase(0, last_newline + 1);
+    }
+    // Last line without a trailing newline
+    if (!pending.empty())
+        submit(std::move(pending));
+}
+
+// Pipelined stdin mode for files of independent expressions:
+// one reader splits stdin into chunks of whole lines, a pool of workers parses and evaluates the chunks (each with its
+// own Grammar from ParserSession::local()) and a writer emits the chunk outputs in input order, one large write per chunk
+// Every chunk starts from a copy of the latest snapshot of the Environment, so assignments are only visible to the
+// following lines of the same chunk
+class Pipeline {
+public:
+    //Bytes read per chunk, the chunk is cut back to the last newline
+    static constexpr std::size_t chunk_size = 1 << 20;
+
+    Pipeline(const Environment& environment, unsigned workers) : environment(environment),
+        workers(std::max(workers, 1u)), work(2 * this->workers), results(4 * this->workers) { }
+
+    void run(std::FILE* input, std::FILE* output) {
+        run([input](auto submit) { read_chunks(input, chunk_size, submit); },
+            [output](const std::string& text) {
+                SIMPLEPARSER_TIMED(Output, std::fwrite(text.data(), 1, text.size(), output));
+            });
+        std::fflush(output);
+    }
+
+    //Same for any source and sink of chunks, f.e. the connection of a distributed Worker. read(submit) runs on a
+    //thread of its own, hands every chunk to submit(std::string) and returns at the end of the input; write(text)
+    //gets the outputs of the chunks in input order. Neither may throw
+    template<typename Read, typename Write>
+    void run(Read read, Write write) {
+        std::thread reader([&] {
+            read([this](std::string text) {
+                submit(std::move(text));
+                return true;
+            });
+            work.close();
+            results.close();
+        });
+        std::vector<std::thread> pool;
+        for (unsigned i = 0; i < workers; ++i)
+            pool.emplace_back([this] { evaluate(); });
+
+        // Writer: futures are queued in input order, so waiting on them one after the other restores the order
+        while (std::optional<std::future<std::string>> result = results.pop())
+            write(result->get());
+
+        reader.join();
+        for (std::thread& worker : pool)
+            worker.join();
+    }
+
+private:
+    struct Chunk {
+        std::string text;
+        std::promise<std::string> result;
+    };
+
+    void submit(std::string text) {
+        Chunk chunk{ std::move(text), {} };
+        results.push(chunk.result.get_future());
+        work.push(std::move(chunk));
+    }
+
+    void evaluate() {
+        Environment::Context context(environment);
+        ParsedLines lines;
+        while (std::optional<Chunk> chunk = work.pop()) {
+            SymbolTable& chunk_symbols = context.reset();
+            std::ostringstream out;
+            run_lines(chunk->text, chunk_symbols, out, lines);
+            chunk->result.set_value(out.str());
+        }
+    }
+
+    const Environment& environment;
+    unsigned workers;
+    BlockingQueue<Chunk> work;
+    BlockingQueue<std::future<std::string>> results;
+};
+
+/******************************************************************************/
+
+#ifdef SIMPLEPARSER_MMAP
+//Same as the line by line mode on stdin, but every line is a view into the mapping and output is only flushed at the end
+void run_mapped(const MappedFile& file, SymbolTable& symbols, std::ostream& out) {
+    ParsedLines lines;
+    run_lines(std::string_view(file.begin(), file.end() - file.begin()), symbols, out, lines);
+}
+#endif
+
+/******************************************************************************/
+
+// Thread pool where every worker has its own deque of tasks
+// Tasks pushed from a worker go to the back of its own deque and are taken from there again (LIFO, cache friendly),
+// idle workers steal from the front of the other deques
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned threads) : queues(std::max(threads, 1u)) {
+        for (unsigned i = 0; i < queues.size(); ++i)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    //From a worker thread the task goes to its own deque, from outside the deques are filled round robin
+    void push(Task task) {
+        std::size_t index = current_worker != nullptr && current_worker->pool == this
+                          ? current_worker->index : next_queue++ % queues.size();
+        // Counted before it becomes visible, so a worker taking it right away never drops queued below zero
+        queued.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(queues[index].mutex);
+            queues[index].tasks.push_back(std::move(task));
+        }
+        {
+            // Taking the lock orders the push before a worker that is about to sleep checks queued
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        wake.notify_one();
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    struct WorkerIdentity {
+        const WorkStealingPool* pool;
+        std::size_t index;
+    };
+
+    std::optional<Task> take(std::size_t self) {
+        {
+            std::lock_guard<std::mutex> lock(queues[self].mutex);
+            if (!queues[self].tasks.empty()) {
+                Task task = std::move(queues[self].tasks.back());
+                queues[self].tasks.pop_back();
+                return task;
+            }
+        }
+        for (std::size_t offset = 1; offset < queues.size(); ++offset) {
+            Queue& victim = queues[(self + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                Task task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return task;
+            }
+        }
+        return std::nullopt;
+    }
+
+    void work(std::size_t self) {
+        WorkerIdentity identity{ this, self };
+        current_worker = &identity;
+        while (true) {
+            if (std::optional<Task> task = take(self)) {
+                queued.fetch_sub(1);
+                (*task)();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() == 0)
+                return;
+        }
+    }
+
+    static thread_local WorkerIdentity* current_worker;
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> queued{ 0 }, next_queue{ 0 };
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+thread_local WorkStealingPool::WorkerIdentity* WorkStealingPool::current_worker = nullptr;
+
+// Runs a script of statements (f.e. "a = x*2", "b += a", "c = pi*x") in parallel as far as its data flow allows
+// Every statement depends on the last earlier writer of each variable it reads or writes (read after write, write after
+// write) and an assignment additionally waits for all earlier readers of its variable since that write (write after read)
+// Statements run as soon as their dependencies are done, so all values and the output match the sequential execution
+class ScriptRunner {
+public:
+    ScriptRunner(SymbolTable& symbols, unsigned threads) : symbols(symbols), threads(threads) { }
+
+    void run(std::istream& input, std::ostream& output) {
+        std::string line;
+        while (std::getline(input, line))
+            add(line);
+        prepare();
+        execute();
+
+        for (const Statement& statement : statements) {
+            if (statement.error.empty())
+                SIMPLEPARSER_TIMED(Output, print_result(output, statement.result));
+            else
+                SIMPLEPARSER_TIMED(Output, output << statement.error);
+        }
+    }
+
+private:
+    struct Statement {
+        SyntaxTree tree;
+        CompiledExpression program;
+        std::string error;
+        double result = 0.0;
+        std::vector<std::size_t> successors;
+        std::atomic<std::size_t> remaining{ 0 };
+    };
+
+    //Parsing runs in order on one thread, it resolves the varnames of all statements into the shared SymbolTable
+    void add(const std::string& line) {
+        statements.emplace_back();
+        SIMPLEPARSER_COUNT(expressions, 1);
+        try {
+            SIMPLEPARSER_TIMED(Parse, ParserSession::local().parse(line, statements.back().tree, symbols));
+            SIMPLEPARSER_COUNT(nodes, statements.back().tree.size());
+        }
+        catch (std::exception& e) {
+            SIMPLEPARSER_COUNT(errors, 1);
+            std::ostringstream error;
+            print_error(error, e);
+            statements.back().error = error.str();
+            statements.back().tree.clear();
+        }
+    }
+
+    void prepare() {
+        // A constant the script assigns to is no constant anymore, otherwise later reads would be folded to the old value
+        for (Statement& statement : statements)
+            if (!statement.tree.empty())
+                if (std::optional<std::uint32_t> slot = assigned_slot(statement.tree))
+                    symbols.set_constant(*slot, false);
+
+        std::vector<std::optional<std::size_t>> last_writer(symbols.size());
+        std::vector<std::vector<std::size_t>> readers(symbols.size());
+        for (std::size_t index = 0; index < statements.size(); ++index) {
+            Statement& statement = statements[index];
+            if (statement.tree.empty())
+                continue;
+            SIMPLEPARSER_TIMED(Optimize, optimize(statement.tree, symbols));
+            statement.program = SIMPLEPARSER_TIMED(Optimize, compile(statement.tree));
+            // Only the Program is needed from here on
+            statement.tree = SyntaxTree();
+
+            std::optional<std::uint32_t> written = assigned_slot(statement.program);
+            for (const Instruction& instruction : statement.program.instructions()) {
+                if (instruction.op != OpCode::PushVariable)
+                    continue;
+                if (last_writer[instruction.variable])
+                    depend(*last_writer[instruction.variable], index);
+                readers[instruction.variable].push_back(index);
+            }
+            if (written) {
+                // Compound assignments read their variable as well, that is covered by the last writer
+                if (last_writer[*written])
+                    depend(*last_writer[*written], index);
+                for (std::size_t reader : readers[*written])
+                    if (reader != index)
+                        depend(reader, index);
+                readers[*written].clear();
+                last_writer[*written] = index;
+            }
+        }
+    }
+
+    //Slot the tree assigns to, an assignment is always the root of its tree
+    static std::optional<std::uint32_t> assigned_slot(const SyntaxTree& tree) {
+        const Node& root = tree[tree.root()];
+        if (is_assignment(root.op))
+            return root.slot;
+        return std::nullopt;
+    }
+
+    //Slot the Program assigns to, assignments are always the last Instruction
+    static std::optional<std::uint32_t> assigned_slot(const CompiledExpression& program) {
+        const Instruction& last = program.instructions().back();
+        if (last.op >= OpCode::Assign)
+            return last.variable;
+        return std::nullopt;
+    }
+
+    void depend(std::size_t before, std::size_t after) {
+        std::vector<std::size_t>& successors = statements[before].successors;
+        if (!successors.empty() && successors.back() == after)
+            return;
+        successors.push_back(after);
+        statements[after].remaining.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void execute() {
+        std::mutex done_mutex;
+        std::condition_variable all_done;
+        std::size_t finished = 0;
+        double* variables = symbols.data();
+
+        // Statements without dependencies are collected upfront, once the workers run the counters change concurrently
+        std::vector<std::size_t> roots;
+        for (std::size_t index = 0; index < statements.size(); ++index)
+            if (statements[index].remaining.load(std::memory_order_relaxed) == 0)
+                roots.push_back(index);
+
+        // Declared before the pool, so the workers are joined before the function they run goes away
+        std::function<void(std::size_t)> run_statement;
+        WorkStealingPool pool(threads);
+        run_statement = [&](std::size_t index) {
+            Statement& statement = statements[index];
+            if (statement.error.empty())
+                statement.result = SIMPLEPARSER_TIMED(Evaluate, statement.program.evaluate(variables));
+            // The last finished dependency releases a successor, it continues on the same worker
+            for (std::size_t successor : statement.successors)
+                if (statements[successor].remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    pool.push([&run_statement, successor] { run_statement(successor); });
+
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if (++finished == statements.size())
+                all_done.notify_one();
+        };
+
+        for (std::size_t index : roots)
+            pool.push([&run_statement, index] { run_statement(index); });
+
+        std::unique_lock<std::mutex> lock(done_mutex);
+        all_done.wait(lock, [&] { return finished == statements.size(); });
+    }
+
+    SymbolTable& symbols;
+    unsigned threads;
+    std::deque<Statement> statements;
+};
+
+
+/******************************************************************************/
+
+// Spreadsheet like mode: "name = term" defines name as a formula of the variables it reads instead of assigning it once
+// Every formula keeps its optimized tree with the last value of each Node and, per variable it reads, the Nodes on the
+// way from those leaves up to its root. Changing a variable (f.e. "x = 5") only recomputes the formulas depending on it,
+// in topological order and in each of them only the Nodes on the paths of the changed variables. A formula whose value
+// stays the same ends the propagation there. Compound assignments change the value of their variable once (it loses its
+// formula), all other lines are evaluated once against the current values
+class ReactiveSheet {
+public:
+    explicit ReactiveSheet(SymbolTable& symbols) : symbols(symbols) {
+        // Every variable may get a formula later, folding would keep its old value in the formulas reading it
+        for (std::uint32_t slot = 0; slot < symbols.size(); ++slot)
+            symbols.set_constant(slot, false);
+    }
+
+    void run(std::istream& input, std::ostream& output) {
+        std::string line;
+        while (std::getline(input, line)) {
+            SIMPLEPARSER_COUNT(expressions, 1);
+            try {
+                double value = update(line);
+                SIMPLEPARSER_TIMED(Output, print_result(output, value));
+            }
+            catch (std::exception& e) {
+                SIMPLEPARSER_COUNT(errors, 1);
+                SIMPLEPARSER_TIMED(Output, print_error(output, e));
+            }
+            flush_when_idle(input, output);
+        }
+    }
+
+    //Applies one line and returns its value, for definitions and assignments the new value of the variable
+    //Throws ParseError for invalid lines and std::runtime_error for a definition that would depend on itself
+    double update(std::string_view line) {
+        SyntaxTree tree;
+        SIMPLEPARSER_TIMED(Parse, ParserSession::local().parse(line, tree, symbols));
+        SIMPLEPARSER_COUNT(nodes, tree.size());
+        SIMPLEPARSER_TIMED(Optimize, optimize(tree, symbols));
+        cells.resize(symbols.size());
+        visited.resize(symbols.size(), 0);
+        changed.resize(symbols.size(), 0);
+
+        const Node& root = tree[tree.root()];
+        if (!is_assignment(root.op))
+            return SIMPLEPARSER_TIMED(Evaluate, tree.evaluate(symbols.data()));
+
+        std::uint32_t slot = root.slot;
+        double before = symbols[slot];
+        if (root.op == OpCode::Assign) {
+            NodeIndex term = root.operands[0];
+            std::unique_ptr<Formula> formula = std::make_unique<Formula>();
+            formula->tree = std::move(tree);
+            formula->tree.set_root(term);
+            prepare(*formula);
+            reject_cycle(slot, *formula);
+            symbols[slot] = SIMPLEPARSER_TIMED(Evaluate, evaluate(*formula));
+            define(slot, std::move(formula));
+        } else {
+            SIMPLEPARSER_TIMED(Evaluate, tree.evaluate(symbols.data()));
+            define(slot, nullptr);
+        }
+        if (!same(before, symbols[slot]))
+            SIMPLEPARSER_TIMED(Evaluate, propagate(slot));
+        return symbols[slot];
+    }
+
+    //Nodes evaluated so far, f.e. to compare against re-evaluating every formula on each change
+    std::size_t recomputed() const {
+        return evaluated_nodes;
+    }
+
+private:
+    struct Formula {
+        //Only the subtree of the root is used, the parser left the right hand side of the definition there
+        SyntaxTree tree;
+        //Nodes reachable from the root in evaluation order, operands always have lower indices than their parent
+        std::vector<NodeIndex> order;
+        //Last value of each Node, by NodeIndex
+        std::vector<double> values;
+        //Per variable read: the Nodes of order whose value depends on it
+        std::vector<std::pair<std::uint32_t, std::vector<NodeIndex>>> paths;
+    };
+
+    struct Cell {
+        std::unique_ptr<Formula> formula;
+        //Variables whose formulas read this one
+        std::vector<std::uint32_t> readers;
+    };
+
+    //Bitwise, so NaN results count as unchanged and -0 versus 0 as changed
+    static bool same(double lhs, double rhs) {
+        return std::memcmp(&lhs, &rhs, sizeof(double)) == 0;
+    }
+
+    void prepare(Formula& formula) {
+        const SyntaxTree& tree = formula.tree;
+        std::vector<bool> reachable(tree.size(), false);
+        reachable[tree.root()] = true;
+        for (NodeIndex index = tree.root() + 1; index-- > 0;) {
+            const Node& node = tree[index];
+            if (!reachable[index] || node.op == OpCode::PushConstant || node.op == OpCode::PushVariable)
+                continue;
+            reachable[node.operands[0]] = reachable[node.operands[1]] = true;
+        }
+        for (NodeIndex index = 0; index <= tree.root(); ++index)
+            if (reachable[index])
+                formula.order.push_back(index);
+        formula.values.resize(tree.size());
+
+        std::vector<bool> depends(tree.size());
+        for (NodeIndex leaf : formula.order) {
+            if (tree[leaf].op != OpCode::PushVariable)
+                continue;
+            std::uint32_t slot = tree[leaf].slot;
+            bool known = std::any_of(formula.paths.begin(), formula.paths.end(),
+                                     [slot](const auto& path) { return path.first == slot; });
+            if (known)
+                continue;
+            std::vector<NodeIndex> path;
+            std::fill(depends.begin(), depends.end(), false);
+            for (NodeIndex index : formula.order) {
+                const Node& node = tree[index];
+                if (node.op == OpCode::PushConstant)
+                    continue;
+                depends[index] = node.op == OpCode::PushVariable
+                               ? node.slot == slot : depends[node.operands[0]] || depends[node.operands[1]];
+                if (depends[index])
+                    path.push_back(index);
+            }
+            formula.paths.emplace_back(slot, std::move(path));
+        }
+    }
+
+    double evaluate(Formula& formula) {
+        for (NodeIndex index : formula.order)
+            recompute(formula, index);
+        evaluated_nodes += formula.order.size();
+        return formula.values[formula.tree.root()];
+    }
+
+    void recompute(Formula& formula, NodeIndex index) {
+        const Node& node = formula.tree[index];
+        if (node.op == OpCode::PushConstant)
+            formula.values[index] = node.constant;
+        else if (node.op == OpCode::PushVariable)
+            formula.values[index] = symbols[node.slot];
+        else
+            formula.values[index] = apply_operator(node.op, formula.values[node.operands[0]],
+                                                   formula.values[node.operands[1]]);
+    }
+
+    //A formula for slot must not read slot itself or any variable whose formula (indirectly) reads slot
+    void reject_cycle(std::uint32_t slot, const Formula& formula) {
+        ++generation;
+        walk_readers(slot, [](std::uint32_t) { });
+        for (const auto& path : formula.paths)
+            if (visited[path.first] == generation)
+                throw std::runtime_error("Cyclic definition of " + symbols.name(slot));
+    }
+
+    //Replaces the formula of slot (nullptr makes it a plain value) and keeps the readers of the variables up to date
+    void define(std::uint32_t slot, std::unique_ptr<Formula> formula) {
+        if (const Formula* previous = cells[slot].formula.get())
+            for (const auto& path : previous->paths) {
+                std::vector<std::uint32_t>& readers = cells[path.first].readers;
+                readers.erase(std::find(readers.begin(), readers.end(), slot));
+            }
+        if (formula)
+            for (const auto& path : formula->paths)
+                cells[path.first].readers.push_back(slot);
+        cells[slot].formula = std::move(formula);
+    }
+
+    //Depth first over the readers of slot (slot included), every variable is finished after all of its readers
+    //So the reversed finishing order is a topological order of the affected formulas
+    template<typename Finished>
+    void walk_readers(std::uint32_t slot, Finished&& finished) {
+        std::vector<std::pair<std::uint32_t, std::size_t>>& pending = walk;
+        pending.clear();
+        visited[slot] = generation;
+        pending.emplace_back(slot, 0);
+        while (!pending.empty()) {
+            auto& [current, next] = pending.back();
+            const std::vector<std::uint32_t>& readers = cells[current].readers;
+            if (next == readers.size()) {
+                finished(current);
+                pending.pop_back();
+                continue;
+            }
+            std::uint32_t reader = readers[next++];
+            if (visited[reader] != generation) {
+                visited[reader] = generation;
+                pending.emplace_back(reader, 0);
+            }
+        }
+    }
+
+    void propagate(std::uint32_t slot) {
+        ++generation;
+        affected.clear();
+        walk_readers(slot, [this](std::uint32_t finished) { affected.push_back(finished); });
+        changed[slot] = generation;
+
+        // The last finished is slot itself, everything else reads it directly or indirectly
+        for (auto it = affected.rbegin() + 1; it != affected.rend(); ++it) {
+            Formula& formula = *cells[*it].formula;
+            dirty.clear();
+            std::size_t paths = 0;
+            for (const auto& path : formula.paths)
+                if (changed[path.first] == generation) {
+                    dirty.insert(dirty.end(), path.second.begin(), path.second.end());
+                    ++paths;
+                }
+            if (paths == 0)
+                continue;
+            if (paths > 1) {
+                std::sort(dirty.begin(), dirty.end());
+                dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+            }
+            for (NodeIndex index : dirty)
+                recompute(formula, index);
+            evaluated_nodes += dirty.size();
+
+            double value = formula.values[formula.tree.root()];
+            if (!same(value, symbols[*it])) {
+                symbols[*it] = value;
+                changed[*it] = generation;
+            }
+        }
+    }
+
+    SymbolTable& symbols;
+    //By SymbolTable slot
+    std::vector<Cell> cells;
+    //Reused between updates: marks of the current walk (equal to generation) instead of clearing per update
+    std::vector<std::uint64_t> visited, changed;
+    std::uint64_t generation = 0;
+    std::vector<std::pair<std::uint32_t, std::size_t>> walk;
+    std::vector<std::uint32_t> affected;
+    std::vector<NodeIndex> dirty;
+    std::size_t evaluated_nodes = 0;
+};
+
+/******************************************************************************/
+
+// Batch of expressions hash-consed into one DAG: equal subtrees of all lines become a single Node, so a subexpression
+// shared by hundreds of lines is stored and evaluated once per binding of the variables
+// Lines keep their sequential meaning: a variable leaf is keyed by the number of assignments to it earlier in the
+// batch, so "x" before and after "x += 1" are different Nodes. Assignments are only ever roots and never shared.
+// Nodes are appended operands first and in line order, one pass in index order evaluates the whole batch
+class ExpressionDag {
+public:
+    //Lines of a batch in run(), a larger input is evaluated in several batches
+    static constexpr std::size_t batch_lines = 1 << 16;
+
+    explicit ExpressionDag(SymbolTable& symbols) : symbols(symbols) { }
+
+    //Reads lines until the end of input and prints exactly what the stdin mode prints for them
+    void run(std::istream& input, std::ostream& output) {
+        std::vector<std::optional<NodeIndex>> roots;
+        std::vector<std::string> errors;
+        auto flush = [&] {
+            SIMPLEPARSER_TIMED(Evaluate, evaluate(symbols.data()));
+            std::size_t error = 0;
+            for (const std::optional<NodeIndex>& root : roots) {
+                if (root)
+                    SIMPLEPARSER_TIMED(Output, print_result(output, value(*root)));
+                else
+                    output << errors[error++];
+            }
+            roots.clear();
+            errors.clear();
+            clear();
+        };
+
+        std::string line;
+        while (std::getline(input, line)) {
+            SIMPLEPARSER_COUNT(expressions, 1);
+            try {
+                roots.push_back(add(line));
+            }
+            catch (std::exception& e) {
+                SIMPLEPARSER_COUNT(errors, 1);
+                std::ostringstream text;
+                print_error(text, e);
+                roots.push_back(std::nullopt);
+                errors.push_back(text.str());
+            }
+            // Later lines fold constants with their value while parsing, so a new value has to be applied first
+            if (roots.size() == batch_lines || (roots.back() && is_assignment(nodes[*roots.back()].op) &&
+                                                symbols.is_constant(nodes[*roots.back()].slot)))
+                flush();
+        }
+        flush();
+    }
+
+    //Parses and optimizes line and merges it into the DAG, returns its root (throws ParseError)
+    NodeIndex add(std::string_view line) {
+        SIMPLEPARSER_TIMED(Parse, ParserSession::local().parse(line, tree, symbols));
+        SIMPLEPARSER_COUNT(nodes, tree.size());
+        SIMPLEPARSER_TIMED(Optimize, optimize(tree, symbols));
+        versions.resize(symbols.size(), 0);
+
+        // Operands have lower indices than their parent, one backward pass finds the Nodes the optimizer kept
+        NodeIndex root = tree.root();
+        reachable.assign(std::size_t(root) + 1, false);
+        reachable[root] = true;
+        for (NodeIndex i = root + 1; i-- > 0;) {
+            const Node& node = tree[i];
+            if (!reachable[i] || node.op == OpCode::PushConstant || node.op == OpCode::PushVariable)
+                continue;
+            reachable[node.operands[0]] = true;
+            if (!is_assignment(node.op))
+                reachable[node.operands[1]] = true;
+        }
+
+        shared.resize(reachable.size());
+        for (NodeIndex i = 0; i <= root; ++i) {
+            if (!reachable[i])
+                continue;
+            Node node = tree[i];
+            if (node.op != OpCode::PushConstant && node.op != OpCode::PushVariable) {
+                node.operands[0] = shared[node.operands[0]];
+                if (!is_assignment(node.op))
+                    node.operands[1] = shared[node.operands[1]];
+            }
+            shared[i] = intern(node);
+        }
+        if (is_assignment(tree[root].op))
+            ++versions[tree[root].slot];
+        return shared[root];
+    }
+
+    //Evaluates every Node once, variables is indexed by slot (f.e. SymbolTable::data()) and gets the assignments
+    void evaluate(double* variables) {
+        values.resize(nodes.size());
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            const Node& node = nodes[i];
+            if (node.op == OpCode::PushConstant)
+                values[i] = node.constant;
+            else if (node.op == OpCode::PushVariable)
+                values[i] = variables[node.slot];
+            else if (is_assignment(node.op))
+                values[i] = apply_assignment(node.op, variables[node.slot], values[node.operands[0]]);
+            else
+                values[i] = apply_operator(node.op, values[node.operands[0]], values[node.operands[1]]);
+        }
+    }
+
+    //Value of a root returned by add() in the last evaluate()
+    double value(NodeIndex root) const {
+        return values[root];
+    }
+
+    //Nodes of the DAG, f.e. to compare against the Nodes of all lines
+    std::size_t size() const {
+        return nodes.size();
+    }
+
+    //Starts a new batch, later lines share nothing with the earlier ones
+    void clear() {
+        nodes.clear();
+        index.clear();
+        std::fill(versions.begin(), versions.end(), 0);
+    }
+
+private:
+    //Operator, slot and (by kind of Node) the constant bits, the operands or the version of the variable
+    struct Key {
+        OpCode op;
+        std::uint32_t slot;
+        std::uint64_t payload;
+
+        bool operator==(const Key& other) const {
+            return op == other.op && slot == other.slot && payload == other.payload;
+        }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            std::uint64_t hash = (key.payload ^ (std::uint64_t(key.slot) << 8 | std::uint64_t(key.op))) *
+                                 0x9E3779B97F4A7C15ull;
+            return std::size_t(hash ^ (hash >> 29));
+        }
+    };
+
+    NodeIndex intern(const Node& node) {
+        if (is_assignment(node.op))
+            return append(node);
+        Key key{ node.op, node.slot, 0 };
+        if (node.op == OpCode::PushConstant)
+            std::memcpy(&key.payload, &node.constant, sizeof(double));
+        else if (node.op == OpCode::PushVariable)
+            key.payload = versions[node.slot];
+        else
+            key.payload = std::uint64_t(node.operands[0]) << 32 | node.operands[1];
+        auto [it, inserted] = index.emplace(key, NodeIndex(nodes.size()));
+        if (inserted)
+            append(node);
+        return it->second;
+    }
+
+    NodeIndex append(const Node& node) {
+        nodes.push_back(node);
+        return NodeIndex(nodes.size() - 1);
+    }
+
+    SymbolTable& symbols;
+    std::vector<Node> nodes;
+    std::unordered_map<Key, NodeIndex, KeyHash> index;
+    //Assignments to each slot so far in this batch
+    std::vector<std::uint64_t> versions;
+    //By NodeIndex of the DAG, from the last evaluate()
+    std::vector<double> values;
+    //Scratch of add(), by NodeIndex of the line: kept by the optimizer, Node of the DAG
+    SyntaxTree tree;
+    std::vector<bool> reachable;
+    std::vector<NodeIndex> shared;
+};
+
+/******************************************************************************/
+
+#ifdef SIMPLEPARSER_SERVER
+// Line protocol server over TCP and Unix sockets: every line a client sends is one expression, the answer is exactly
+// what the stdin mode prints for it. Every connection has its own variables (a Context of the Environment), so the
+// assignments of one client are never seen by another
+// One thread runs all connections, they share its ParserSession and cache. Lines that arrived together are evaluated
+// in rounds of one line per connection, so the lines of a connection stay in order; equal expressions of a round run
+// as one batch through the BatchEvaluator, with a column per variable and a row per connection
+class Server {
+public:
+    // Deliberately the default BatchPower::Exact kernels, not the SIMD approximation of '^': a line evaluated in a
+    // batch has to print the same digits as when it runs alone through testGrammar()
+    explicit Server(const Environment& environment) : environment(environment), evaluator(batch_kernels()) { }
+
+    void listen(unsigned short port) {
+        asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
+        tcp_acceptors.emplace_back(io, endpoint);
+        accept(tcp_acceptors.back());
+    }
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    //Replaces a socket file left behind by an earlier run
+    void listen(const std::string& path) {
+        ::unlink(path.c_str());
+        unix_acceptors.emplace_back(io, asio::local::stream_protocol::endpoint(path));
+        accept(unix_acceptors.back());
+    }
+#endif
+
+    //Serves until the process is stopped
+    void run() {
+        io.run();
+    }
+
+private:
+    using Socket = asio::generic::stream_protocol::socket;
+
+    struct Connection {
+        Connection(Socket socket, const Environment& environment) : socket(std::move(socket)), context(environment) { }
+
+        Socket socket;
+        Environment::Context context;
+        //Received bytes, the lines before consumed are answered already
+        std::string input;
+        std::size_t consumed = 0;
+        //Answers not sent yet, and the ones the running write is sending
+        std::ostringstream output;
+        std::string sending;
+        std::array<char, 4096> buffer;
+        //finished: no more reads (end of input or error), failed: the socket is unusable, answers are dropped
+        bool writing = false, finished = false, failed = false;
+    };
+
+    using ConnectionList = std::list<Connection>;
+
+    struct Request {
+        Connection* connection;
+        std::string_view line;
+    };
+
+    template<typename Acceptor>
+    void accept(Acceptor& acceptor) {
+        acceptor.async_accept([this, &acceptor](boost::system::error_code error,
+                                                typename Acceptor::protocol_type::socket socket) {
+            if (!error) {
+                connections.emplace_back(Socket(std::move(socket)), environment);
+                read(std::prev(connections.end()));
+            }
+            accept(acceptor);
+        });
+    }
+
+    void read(ConnectionList::iterator connection) {
+        connection->socket.async_read_some(asio::buffer(connection->buffer),
+                                           [this, connection](boost::system::error_code error, std::size_t size) {
+            if (error) {
+                // The lines sent before the end (incl. one without newline) are still answered
+                connection->finished = true;
+            } else {
+                connection->input.append(connection->buffer.data(), size);
+                read(connection);
+            }
+            schedule();
+        });
+    }
+
+    //Evaluation waits for the handlers that are ready already, so requests arriving together end up in one round
+    void schedule() {
+        if (scheduled)
+            return;
+        scheduled = true;
+        asio::post(io, [this] {
+            scheduled = false;
+            evaluate_pending();
+        });
+    }
+
+    void evaluate_pending() {
+        std::vector<Request>& round = requests;
+        while (true) {
+            round.clear();
+            for (Connection& connection : connections) {
+                std::string_view line;
+                if (next_line(connection, line))
+                    round.push_back({ &connection, line });
+            }
+            if (round.empty())
+                break;
+            evaluate(round);
+        }
+
+        for (auto connection = connections.begin(); connection != connections.end();) {
+            auto current = connection++;
+            current->input.erase(0, current->consumed);
+            current->consumed = 0;
+            write(current);
+        }
+    }
+
+    static bool next_line(Connection& connection, std::string_view& line) {
+        std::string_view rest = std::string_view(connection.input).substr(connection.consumed);
+        std::size_t newline = rest.find('\n');
+        if (newline == std::string_view::npos && !(connection.finished && !rest.empty()))
+            return false;
+        line = rest.substr(0, newline);
+        connection.consumed += newline == std::string_view::npos ? rest.size() : newline + 1;
+        return true;
+    }
+
+    void evaluate(std::vector<Request>& round) {
+        ParserSession& session = ParserSession::local();
+        keys.resize(round.size());
+        order.resize(round.size());
+        for (std::size_t i = 0; i < round.size(); ++i) {
+            ExpressionCache::normalize(round[i].line, keys[i]);
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [this](std::size_t lhs, std::size_t rhs) {
+            return keys[lhs] < keys[rhs];
+        });
+
+        for (std::size_t first = 0; first < order.size();) {
+            std::size_t last = first + 1;
+            while (last < order.size() && keys[order[last]] == keys[order[first]])
+                ++last;
+
+            // The first one fills the cache (or reports the error), the others batch up behind its Program
+            // Only testGrammar() and evaluate_batch() count, the lookups that group the rows peek
+            Request& leader = round[order[first]];
+            testGrammar(leader.line, leader.connection->context.symbols(), leader.connection->output);
+            const std::string& key = keys[order[first]];
+            HotExpression* program = last - first > 1
+                ? session.cache().peek(key, leader.connection->context.symbols()) : nullptr;
+
+            batch.clear();
+            single.clear();
+            for (std::size_t i = first + 1; i < last; ++i) {
+                Request& request = round[order[i]];
+                if (program && session.cache().peek(key, request.connection->context.symbols()) == program)
+                    batch.push_back(&request);
+                else
+                    single.push_back(&request);
+            }
+            if (batch.size() > 1)
+                evaluate_batch(program->compiled(), batch);
+            else
+                single.insert(single.end(), batch.begin(), batch.end());
+            // Only now, parsing these may evict the Program of the batch
+            for (Request* request : single)
+                testGrammar(request->line, request->connection->context.symbols(), request->connection->output);
+            first = last;
+        }
+    }
+
+    void evaluate_batch(const CompiledExpression& program, const std::vector<Request*>& rows) {
+        SIMPLEPARSER_COUNT(expressions, rows.size());
+        SIMPLEPARSER_COUNT(cache_hits, rows.size());
+        std::uint32_t slots = 0;
+        for (const Instruction& instruction : program.instructions())
+            if (instruction.op == OpCode::PushVariable || is_assignment(instruction.op))
+                slots = std::max(slots, instruction.variable + 1);
+
+        // One column per variable the Program uses, row i holds the value of the variable for connection i
+        columns.assign(slots, nullptr);
+        values.resize(std::size_t(slots) * rows.size());
+        for (const Instruction& instruction : program.instructions()) {
+            if ((instruction.op != OpCode::PushVariable && !is_assignment(instruction.op)) || columns[instruction.variable])
+                continue;
+            double* column = values.data() + std::size_t(instruction.variable) * rows.size();
+            for (std::size_t row = 0; row < rows.size(); ++row)
+                column[row] = rows[row]->connection->context.symbols()[instruction.variable];
+            columns[instruction.variable] = column;
+        }
+
+        results.resize(rows.size());
+        SIMPLEPARSER_TIMED(Evaluate, evaluator.evaluate(program, columns.data(), values.data(), rows.size(),
+                                                        results.data()));
+        // The BatchEvaluator leaves the variables alone, assignments are written back per connection
+        const Instruction& last = program.instructions().back();
+        for (std::size_t row = 0; row < rows.size(); ++row) {
+            if (is_assignment(last.op))
+                rows[row]->connection->context.symbols()[last.variable] = results[row];
+            SIMPLEPARSER_TIMED(Output, print_result(rows[row]->connection->output, results[row]));
+        }
+    }
+
+    //Sends what accumulated while no write was running, removes connections that have nothing left to do
+    //A connection is only erased once neither a read nor a write of it is running, their handlers refer to it
+    void write(ConnectionList::iterator connection) {
+        if (connection->writing)
+            return;
+        connection->sending = connection->failed ? std::string() : connection->output.str();
+        connection->output.str(std::string());
+        if (connection->sending.empty()) {
+            if (connection->finished)
+                connections.erase(connection);
+            return;
+        }
+        connection->writing = true;
+        asio::async_write(connection->socket, asio::buffer(connection->sending),
+                          [this, connection](boost::system::error_code error, std::size_t) {
+            connection->writing = false;
+            if (error) {
+                // Closing ends a running read as well, its handler finishes the connection
+                connection->failed = true;
+                boost::system::error_code ignored;
+                connection->socket.close(ignored);
+            }
+            write(connection);
+        });
+    }
+
+    const Environment& environment;
+    asio::io_context io;
+    std::list<asio::ip::tcp::acceptor> tcp_acceptors;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    std::list<asio::local::stream_protocol::acceptor> unix_acceptors;
+#endif
+    ConnectionList connections;
+    bool scheduled = false;
+
+    BatchEvaluator evaluator;
+    //Reused by every round
+    std::vector<Request> requests;
+    std::vector<std::string> keys;
+    std::vector<std::size_t> order;
+    std::vector<Request*> batch, single;
+    std::vector<const double*> columns;
+    std::vector<double> values, results;
+};
+#endif
+
+/******************************************************************************/
+
+//Variables every run starts with, the ones of main() and of every job of a distributed Worker
+void initial_variables(SymbolTable& symbols) {
+    symbols.set("x", 42);
+    symbols.set("pi", 3.14159265359);
+    symbols.mark_constant("pi");
+}
+
+#if defined(SIMPLEPARSER_SERVER) && defined(SIMPLEPARSER_MMAP)
+// Distributed pipelined mode: a Coordinator splits stdin into chunks like the Pipeline, streams them to Worker
+// processes on other hosts and writes their outputs in input order. Every chunk starts from the initial variables,
+// so the output is exactly the one of --threads. Chunks go to whichever Worker has room, faster ones get more
+// The formulas are shipped once per job as a CompiledLibrary, after that only the lines of the input are sent; lines
+// of the library run from its bytecode, all others are parsed in batches as in the Pipeline
+// Both ends talk in Frames, all in native byte order (like the library, every host has to be the same platform):
+//   coordinator -> worker  Job, optionally Library, any number of Chunks, End
+//   worker -> coordinator  one Result per Chunk in the same order, or an Error and then nothing
+struct Frame {
+    enum Kind : std::uint32_t { Job, Library, Chunk, Result, Error, End };
+
+    struct Header {
+        Kind kind;
+        std::uint32_t reserved;
+        std::uint64_t size;
+    };
+
+    //Payload of a Job, what the worker needs to produce the same output as the coordinator would
+    struct Settings {
+        std::uint32_t format, reserved;
+        std::uint64_t max_nodes, max_nesting, max_variables;
+    };
+
+    //Throws boost::system::system_error if the connection fails
+    static void send(asio::ip::tcp::socket& socket, Kind kind, std::string_view payload) {
+        Header header{ kind, 0, payload.size() };
+        std::array<asio::const_buffer, 2> buffers{ asio::buffer(&header, sizeof(header)), asio::buffer(payload) };
+        asio::write(socket, buffers);
+    }
+
+    //False at the end of the connection, it may only end between Frames
+    static bool receive(asio::ip::tcp::socket& socket, Kind& kind, std::string& payload) {
+        Header header;
+        boost::system::error_code error;
+        asio::read(socket, asio::buffer(&header, sizeof(header)), error);
+        if (error == asio::error::eof)
+            return false;
+        if (error)
+            throw boost::system::system_error(error);
+        if (header.kind > End)
+            throw std::runtime_error("Invalid frame");
+        kind = header.kind;
+        payload.resize(header.size);
+        asio::read(socket, asio::buffer(payload));
+        return true;
+    }
+};
+
+// Worker end: serves one job at a time on its port, the chunks of a job run on a Pipeline of its own threads
+// Strictly one at a time: the job sets the process wide limits(), output_format() and CompiledLibrary::installed(),
+// which is only safe because its Pipeline starts after that and has joined all of its threads when serve() returns
+// The library of a job is written to a temporary file and mapped from there, it is removed again right away
+class Worker {
+public:
+    explicit Worker(unsigned threads) : threads(std::max(threads, 1u)) { }
+
+    //Serves coordinators one after another until the process is stopped
+    void listen(unsigned short port) {
+        asio::ip::tcp::acceptor acceptor(io, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port));
+        for (;;) {
+            asio::ip::tcp::socket socket(io);
+            acceptor.accept(socket);
+            try {
+                serve(socket);
+            }
+            catch (std::exception& e) {
+                std::cerr << "Job failed: " << e.what() << std::endl;
+            }
+            CompiledLibrary::installed() = nullptr;
+        }
+    }
+
+private:
+    void serve(asio::ip::tcp::socket& socket) {
+        Frame::Kind kind;
+        std::string payload;
+        Frame::Settings settings;
+        if (!Frame::receive(socket, kind, payload) || kind != Frame::Job || payload.size() != sizeof(settings))
+            throw std::runtime_error("Expected a job");
+        std::memcpy(&settings, payload.data(), sizeof(settings));
+        // No thread of the previous job is left and none of this one has started yet, see the class comment
+        output_format() = OutputFormat(settings.format);
+        limits() = Limits{ settings.max_nodes, settings.max_nesting, settings.max_variables };
+
+        Environment environment;
+        environment.modify(initial_variables);
+        std::optional<CompiledLibrary> library;
+        bool more = Frame::receive(socket, kind, payload);
+        if (more && kind == Frame::Library) {
+            try {
+                map(payload, library);
+            }
+            catch (std::exception& e) {
+                Frame::send(socket, Frame::Error, e.what());
+                throw;
+            }
+            environment.modify([&library](SymbolTable& symbols) { library->bind(symbols); });
+            CompiledLibrary::installed() = &*library;
+            more = Frame::receive(socket, kind, payload);
+        }
+
+        // The Pipeline threads must not throw, a broken connection just ends the job
+        bool failed = false;
+        Pipeline(environment, threads).run(
+            [&](auto submit) {
+                try {
+                    while (more && kind == Frame::Chunk) {
+                        submit(std::move(payload));
+                        more = Frame::receive(socket, kind, payload);
+                    }
+                }
+                catch (std::exception&) {
+                    more = false;
+                }
+            },
+            [&](const std::string& text) {
+                try {
+                    if (!failed)
+                        Frame::send(socket, Frame::Result, text);
+                }
+                catch (std::exception&) {
+                    failed = true;
+                }
+            });
+    }
+
+    //Library from the bytes of a Frame, mapped from a temporary file like any other library file
+    static void map(const std::string& bytes, std::optional<CompiledLibrary>& library) {
+        const char* directory = std::getenv("TMPDIR");
+        std::string path = std::string(directory ? directory : "/tmp") + "/simpleparser-XXXXXX";
+        int fd = ::mkstemp(&path[0]);
+        if (fd < 0)
+            throw std::runtime_error("Cannot create " + path);
+        bool written = ::write(fd, bytes.data(), bytes.size()) == ssize_t(bytes.size());
+        ::close(fd);
+        try {
+            if (!written)
+                throw std::runtime_error("Cannot write " + path);
+            library.emplace(path);
+            ::unlink(path.c_str());
+        }
+        catch (...) {
+            ::unlink(path.c_str());
+            throw;
+        }
+    }
+
+    unsigned threads;
+    asio::io_context io;
+};
+
+// Coordinator end: one sending and one receiving thread per Worker, the Worker answers its Chunks in the order it got
+// them, so the receiver matches each Result to the oldest Chunk it still waits for
+// If a Worker fails the job stops: nothing after the last complete chunk before the failure is written, run() throws
+class Coordinator {
+public:
+    //Chunks a Worker gets ahead of its Results, keeps it busy while Results and the next Chunks are on their way
+    static constexpr std::size_t window = 4;
+
+    //workers are "host:port", library the bytes of a compiled library (may be empty)
+    Coordinator(std::vector<std::string> workers, std::string library) : addresses(std::move(workers)),
+        library(std::move(library)), work(2 * window * addresses.size()), results(4 * window * addresses.size()) { }
+
+    void run(std::FILE* input, std::FILE* output) {
+        Frame::Settings settings{ std::uint32_t(output_format()), 0, limits().max_nodes, limits().max_nesting,
+                                  limits().max_variables };
+        std::list<Connection> connections;
+        for (const std::string& address : addresses) {
+            std::size_t colon = address.rfind(':');
+            if (colon == std::string::npos)
+                throw std::runtime_error("Worker " + address + " is not host:port");
+            Connection& connection = connections.emplace_back(io);
+            connection.address = address;
+            try {
+                asio::ip::tcp::resolver resolver(io);
+                asio::connect(connection.socket, resolver.resolve(address.substr(0, colon), address.substr(colon + 1)));
+                connection.socket.set_option(asio::ip::tcp::no_delay(true));
+                Frame::send(connection.socket, Frame::Job, std::string_view(reinterpret_cast<const char*>(&settings),
+                                                                            sizeof(settings)));
+                if (!library.empty())
+                    Frame::send(connection.socket, Frame::Library, library);
+            }
+            catch (std::exception& e) {
+                throw std::runtime_error("Cannot start the job on worker " + address + ": " + e.what());
+            }
+        }
+
+        std::thread reader([&] {
+            read_chunks(input, Pipeline::chunk_size, [this](std::string text) {
+                if (failed)
+                    return false;
+                Pending chunk{ std::move(text), {} };
+                results.push(chunk.result.get_future());
+                work.push(std::move(chunk));
+                return true;
+            });
+            work.close();
+            results.close();
+        });
+        std::vector<std::thread> threads;
+        for (Connection& connection : connections) {
+            threads.emplace_back([this, &connection] { send(connection); });
+            threads.emplace_back([this, &connection] { receive(connection); });
+        }
+
+        // Past the first failure the remaining futures are only drained, so every thread gets to its end
+        std::string error;
+        while (std::optional<std::future<std::string>> result = results.pop()) {
+            try {
+                std::string text = result->get();
+                if (error.empty())
+                    SIMPLEPARSER_TIMED(Output, std::fwrite(text.data(), 1, text.size(), output));
+            }
+            catch (std::exception& e) {
+                if (error.empty())
+                    error = e.what();
+            }
+        }
+        std::fflush(output);
+
+        reader.join();
+        for (std::thread& thread : threads)
+            thread.join();
+        if (!error.empty())
+            throw std::runtime_error(failure.empty() ? error : failure);
+    }
+
+private:
+    struct Pending {
+        std::string text;
+        std::promise<std::string> result;
+    };
+
+    struct Connection {
+        explicit Connection(asio::io_context& io) : socket(io), in_flight(window) { }
+
+        std::string address;
+        asio::ip::tcp::socket socket;
+        //Promises of the Chunks sent, oldest first
+        BlockingQueue<std::promise<std::string>> in_flight;
+    };
+
+    //Takes Chunks for connection until the input ends, fails them directly once the job has failed
+    void send(Connection& connection) {
+        while (std::optional<Pending> chunk = work.pop()) {
+            if (failed) {
+                fail(chunk->result);
+                continue;
+            }
+            // Queued before sending, the Result might be back before send() returns
+            connection.in_flight.push(std::move(chunk->result));
+            try {
+                Frame::send(connection.socket, Frame::Chunk, chunk->text);
+            }
+            catch (std::exception&) {
+                // The receiver reports it, it is going to wait for this Result on a closed connection
+                stop(connection);
+            }
+        }
+        try {
+            if (!failed)
+                Frame::send(connection.socket, Frame::End, {});
+        }
+        catch (std::exception&) {
+            stop(connection);
+        }
+        connection.in_flight.close();
+    }
+
+    void receive(Connection& connection) {
+        while (std::optional<std::promise<std::string>> result = connection.in_flight.pop()) {
+            if (failed) {
+                fail(*result);
+                continue;
+            }
+            try {
+                Frame::Kind kind;
+                std::string payload;
+                if (!Frame::receive(connection.socket, kind, payload))
+                    throw std::runtime_error("connection closed");
+                if (kind == Frame::Error)
+                    throw std::runtime_error(payload);
+                if (kind != Frame::Result)
+                    throw std::runtime_error("unexpected frame");
+                result->set_value(std::move(payload));
+            }
+            catch (std::exception& e) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (failure.empty())
+                        failure = "Worker " + connection.address + " failed: " + e.what();
+                }
+                stop(connection);
+                fail(*result);
+            }
+        }
+    }
+
+    //Ends the job after a failure of connection, a blocked read or write of it returns with an error
+    void stop(Connection& connection) {
+        failed = true;
+        boost::system::error_code ignored;
+        connection.socket.shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+    }
+
+    void fail(std::promise<std::string>& result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.set_exception(std::make_exception_ptr(std::runtime_error(failure.empty() ? "Job failed" : failure)));
+    }
+
+    std::vector<std::string> addresses;
+    std::string library;
+    asio::io_context io;
+    //The first failure of a Worker, the error of every chunk after it
+    std::atomic<bool> failed{ false };
+    std::mutex mutex;
+    std::string failure;
+    BlockingQueue<Pending> work;
+    BlockingQueue<std::future<std::string>> results;
+};
+#endif
+
+/******************************************************************************/
+
+// bench.cpp includes this file and brings its own main
+#ifndef SIMPLEPARSER_NO_MAIN
+//Value of a numeric option: decimal digits only and at most max, nullopt for anything else (main then prints the usage)
+std::optional<std::size_t> number_named(std::string_view text,
+                                        std::size_t max = std::numeric_limits<std::size_t>::max()) {
+    std::size_t value = 0;
+    const char* end = text.data() + text.size();
+    auto [last, error] = std::from_chars(text.data(), end, value);
+    if (text.empty() || error != std::errc() || last != end || value > max)
+        return std::nullopt;
+    return value;
+}
+
+int main(int argc, char** argv) {
+    // --threads N switches to the pipelined mode with N workers (0 = one per core)
+    // --script runs stdin as one script, independent statements in parallel (on --threads workers, default one per core)
+    // --mmap FILE evaluates the lines of FILE like stdin, but parses them in place from a memory mapping
+    // --reactive keeps "name = term" lines as formulas, a change of a variable only recomputes what depends on it
+    // --listen PORT / --listen-unix PATH serves the same line protocol to socket clients (built with SERVER=1)
+    // --shared evaluates stdin in batches, subexpressions shared by several lines are evaluated only once
+    // --compile-library FILE compiles the lines of stdin into FILE, --library FILE runs them from there without parsing
+    // --output text|csv|binary selects the format of the results, with csv / binary the status lines go to stderr
+    // --max-nodes N / --max-nesting N / --max-variables N set the limits() an input fails on instead of growing
+    // --worker PORT serves jobs of a coordinator, --coordinator HOST:PORT,... runs stdin like --threads on those
+    // workers, shipping them the --library once (both built with SERVER=1)
+    // Every line reads faster without the stdio sync, and only then std::cin knows if more input is waiting
+    std::ios::sync_with_stdio(false);
+#ifdef SIMPLEPARSER_STATS
+    stats::install();
+#endif
+    std::optional<unsigned> threads;
+    bool script = false, reactive = false, shared = false;
+    std::optional<std::string> mapped, library_path, compile_path;
+    std::optional<unsigned short> port;
+    std::optional<std::string> socket_path;
+    std::optional<unsigned short> worker_port;
+    std::vector<std::string> workers;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--threads" && i + 1 < argc &&
+            number_named(argv[i + 1], std::numeric_limits<unsigned>::max())) {
+            threads = static_cast<unsigned>(*number_named(argv[++i]));
+            if (*threads == 0)
+                threads = std::thread::hardware_concurrency();
+        } else if (argument == "--script") {
+            script = true;
+        } else if (argument == "--reactive") {
+            reactive = true;
+        } else if (argument == "--shared") {
+            shared = true;
+        } else if (argument == "--output" && i + 1 < argc && output_format_named(argv[i + 1])) {
+            output_format() = *output_format_named(argv[++i]);
+        } else if (argument == "--max-nodes" && i + 1 < argc && number_named(argv[i + 1])) {
+            limits().max_nodes = *number_named(argv[++i]);
+        } else if (argument == "--max-nesting" && i + 1 < argc && number_named(argv[i + 1])) {
+            limits().max_nesting = *number_named(argv[++i]);
+        } else if (argument == "--max-variables" && i + 1 < argc && number_named(argv[i + 1])) {
+            limits().max_variables = *number_named(argv[++i]);
+#ifdef SIMPLEPARSER_MMAP
+        } else if (argument == "--mmap" && i + 1 < argc) {
+            mapped = argv[++i];
+        } else if (argument == "--library" && i + 1 < argc) {
+            library_path = argv[++i];
+        } else if (argument == "--compile-library" && i + 1 < argc) {
+            compile_path = argv[++i];
+#endif
+#ifdef SIMPLEPARSER_SERVER
+        } else if (argument == "--listen" && i + 1 < argc && number_named(argv[i + 1], 65535)) {
+            port = static_cast<unsigned short>(*number_named(argv[++i]));
+        } else if (argument == "--listen-unix" && i + 1 < argc) {
+            socket_path = argv[++i];
+#ifdef SIMPLEPARSER_MMAP
+        } else if (argument == "--worker" && i + 1 < argc && number_named(argv[i + 1], 65535)) {
+            worker_port = static_cast<unsigned short>(*number_named(argv[++i]));
+        } else if (argument == "--coordinator" && i + 1 < argc) {
+            std::istringstream list(argv[++i]);
+            for (std::string address; std::getline(list, address, ',');)
+                if (!address.empty())
+                    workers.push_back(address);
+#endif
+#endif
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--threads N] [--script] [--reactive] [--shared] [--output text|csv|binary]"
+                      << " [--max-nodes N] [--max-nesting N] [--max-variables N]"
+#ifdef SIMPLEPARSER_MMAP
+                      << " [--mmap FILE] [--library FILE] [--compile-library FILE]"
+#endif
+#ifdef SIMPLEPARSER_SERVER
+                      << " [--listen PORT] [--listen-unix PATH]"
+#ifdef SIMPLEPARSER_MMAP
+                      << " [--worker PORT] [--coordinator HOST:PORT,...]"
+#endif
+#endif
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    OutputBuffer output(std::cout, stdout);
+    std::ostream& status = output_format() == OutputFormat::Text ? std::cout : std::cerr;
+
+    // important variables
+    Environment environment;
+    environment.modify(initial_variables);
+
+#ifdef SIMPLEPARSER_MMAP
+    if (compile_path) {
+        std::cout << "Reading stdin" << std::endl;
+        SymbolTable symbols = environment.snapshot();
+        CompiledLibrary::Writer writer;
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            try {
+                writer.add(line, symbols);
+            }
+            catch (std::exception& e) {
+                print_error(std::cout, e);
+            }
+        }
+        try {
+            writer.write(*compile_path, symbols);
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << writer.size() << " expressions to " << *compile_path << std::endl;
+        return 0;
+    }
+
+    // Lives until exit, the Programs of every mode may still point into its mapping
+    std::optional<CompiledLibrary> library;
+    if (library_path) {
+        try {
+            library.emplace(*library_path);
+            environment.modify([&library](SymbolTable& symbols) { library->bind(symbols); });
+            CompiledLibrary::installed() = &*library;
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+#endif
+    // The single threaded modes assign to their own copy, the Pipeline gives every chunk a fresh one
+    Environment::Context context(environment);
+    SymbolTable& symbol_table = context.symbols();
+
+#ifdef SIMPLEPARSER_MMAP
+    if (mapped) {
+        status << "Reading " << *mapped << std::endl;
+        std::cout << output_header();
+        try {
+            MappedFile file(*mapped);
+            run_mapped(file, symbol_table, std::cout);
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        std::cout.flush();
+        return 0;
+    }
+#endif
+
+#ifdef SIMPLEPARSER_SERVER
+    if (port || socket_path) {
+        try {
+            Server server(environment);
+            if (port) {
+                server.listen(*port);
+                status << "Listening on port " << *port << std::endl;
+            }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+            if (socket_path) {
+                server.listen(*socket_path);
+                status << "Listening on " << *socket_path << std::endl;
+            }
+#endif
+            server.run();
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+#ifdef SIMPLEPARSER_MMAP
+    if (worker_port) {
+        try {
+            Worker worker(threads.value_or(std::thread::hardware_concurrency()));
+            status << "Worker listening on port " << *worker_port << std::endl;
+            worker.listen(*worker_port);
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+#endif
+#endif
+
+    status << "Reading stdin" << std::endl;
+    std::cout << output_header() << std::flush;
+
+    if (script) {
+        ScriptRunner(symbol_table, threads.value_or(std::thread::hardware_concurrency())).run(std::cin, std::cout);
+        std::cout.flush();
+        return 0;
+    }
+
+    if (reactive) {
+        ReactiveSheet(symbol_table).run(std::cin, std::cout);
+        std::cout.flush();
+        return 0;
+    }
+
+    if (shared) {
+        ExpressionDag(symbol_table).run(std::cin, std::cout);
+        std::cout.flush();
+        return 0;
+    }
+
+#if defined(SIMPLEPARSER_SERVER) && defined(SIMPLEPARSER_MMAP)
+    if (!workers.empty()) {
+        try {
+            std::string bytes;
+            if (library_path) {
+                MappedFile file(*library_path);
+                bytes.assign(file.begin(), file.end());
+            }
+            Coordinator(workers, std::move(bytes)).run(stdin, stdout);
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+#endif
+
+    if (threads) {
+        Pipeline(environment, *threads).run(stdin, stdout);
+        return 0;
+    }
 
     std::string line;
     while (std::getline(std::cin, line)) {
-        testGrammar(line);
+        testGrammar(line, symbol_table, std::cout);
+        flush_when_idle(std::cin, std::cout);
     }
 
     return 0;
 }
+#endif
 
 /******************************************************************************/
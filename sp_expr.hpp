@@ -0,0 +1,633 @@
+// Compile time front end for expressions that are already known when building
+//
+// SP_EXPR("2*x+pi") parses the string literal while compiling into a statically typed expression tree, no Grammar,
+// no Nodes and no virtual calls are left at runtime. The variables become positional arguments in order of their
+// first appearance:
+//
+//      auto area = SP_EXPR("r * r * pi");
+//      double a = area(2.0, 3.14159265359);       // r = 2, pi = 3.14159265359
+//      area.variables[0] == "r"
+//
+// Follows the EBNF and operator semantics of the runtime parser (+, -, *, /, && and || left associative, ^ right),
+// assignments are not supported as there is no variable storage. Invalid input is a compile error.
+// Numbers get the same correctly rounded double as from the runtime parser, one that is too large for a double is a
+// compile error there as well, and names go on across spaces ("a b" is the variable "ab"). sp_expr_check.cpp holds
+// the static_asserts that check both, make check compiles it.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <math.h>
+
+namespace sp_expr {
+
+/******************************************************************************/
+// Character level helpers, all constexpr so the parser can run inside template arguments
+
+constexpr bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v'; }
+constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+constexpr bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+constexpr bool is_alnum(char c) { return is_alpha(c) || is_digit(c); }
+
+constexpr std::size_t skip_space(std::string_view text, std::size_t pos) {
+    while (pos < text.size() && is_space(text[pos]))
+        ++pos;
+    return pos;
+}
+
+constexpr char at(std::string_view text, std::size_t pos) {
+    return pos < text.size() ? text[pos] : '\0';
+}
+
+//Invalid input ends the constant evaluation, which turns into a compile error at the SP_EXPR
+inline void invalid_expression() { }
+constexpr void expect(bool valid) {
+    if (!valid)
+        invalid_expression();
+}
+
+//End of a varname, which like in the runtime parser goes on after spaces as long as an alphanumeric follows
+constexpr std::size_t identifier_end(std::string_view text, std::size_t pos) {
+    std::size_t end = pos;
+    for (std::size_t next = pos; next < text.size() && is_alnum(text[next]); next = skip_space(text, next))
+        end = ++next;
+    return end;
+}
+
+//Equal varnames, spaces inside them do not count
+constexpr bool same_name(std::string_view left, std::string_view right) {
+    for (std::size_t i = 0, j = 0;; ++i, ++j) {
+        i = skip_space(left, i);
+        j = skip_space(right, j);
+        if (i == left.size() || j == right.size())
+            return i == left.size() && j == right.size();
+        if (left[i] != right[j])
+            return false;
+    }
+}
+
+//End of a number like qi::double_ accepts it: [sign] (digits [. digits] | . digits) [(e|E) [sign] digits]
+constexpr std::size_t number_end(std::string_view text, std::size_t pos) {
+    if (at(text, pos) == '+' || at(text, pos) == '-')
+        ++pos;
+    std::size_t digits = 0;
+    while (is_digit(at(text, pos)))
+        ++pos, ++digits;
+    if (at(text, pos) == '.') {
+        ++pos;
+        while (is_digit(at(text, pos)))
+            ++pos, ++digits;
+    }
+    expect(digits > 0);
+    std::size_t exponent = pos;
+    if (at(text, exponent) == 'e' || at(text, exponent) == 'E') {
+        ++exponent;
+        if (at(text, exponent) == '+' || at(text, exponent) == '-')
+            ++exponent;
+        if (is_digit(at(text, exponent))) {
+            while (is_digit(at(text, exponent)))
+                ++exponent;
+            pos = exponent;
+        }
+    }
+    return pos;
+}
+
+/******************************************************************************/
+// Decimal to double, correctly rounded like from_chars in the runtime Lexer so a constant has the same value either way
+// Up to 19 digits and a power of ten up to 22 are one exact multiplication or division, everything else is converted
+// exactly with a fixed size BigInteger. Like in fast_float only the first max_digits digits are kept, the rest only
+// tells whether the value is a bit larger, which is all rounding needs from them
+
+//Unsigned integer of 32 bit limbs, least significant first, large enough for every literal number_value() converts
+struct BigInteger {
+    static constexpr std::size_t limb_count = 128;
+
+    std::array<std::uint32_t, limb_count> limbs{};
+    std::size_t size = 0;
+
+    constexpr explicit BigInteger(std::uint32_t value = 0) {
+        limbs[0] = value;
+        size = value != 0;
+    }
+
+    constexpr void multiply_add(std::uint32_t factor, std::uint32_t addend) {
+        std::uint64_t carry = addend;
+        for (std::size_t i = 0; i < size; ++i) {
+            std::uint64_t product = std::uint64_t(limbs[i]) * factor + carry;
+            limbs[i] = std::uint32_t(product);
+            carry = product >> 32;
+        }
+        if (carry)
+            limbs[size++] = std::uint32_t(carry);
+    }
+
+    constexpr void multiply_power10(int exponent) {
+        for (; exponent >= 9; exponent -= 9)
+            multiply_add(1000000000, 0);
+        std::uint32_t factor = 1;
+        for (; exponent > 0; --exponent)
+            factor *= 10;
+        multiply_add(factor, 0);
+    }
+
+    constexpr void shift_left(std::size_t bits) {
+        std::size_t words = bits / 32, rest = bits % 32;
+        // From the top down, every limb only reads limbs below it that have not been written yet
+        for (std::size_t i = size + words + 1; i-- > words;) {
+            std::uint64_t high = i - words < size ? limbs[i - words] : 0;
+            std::uint64_t low = rest && i > words ? limbs[i - words - 1] : 0;
+            limbs[i] = std::uint32_t((high << rest) | (low >> (32 - rest)));
+        }
+        for (std::size_t i = 0; i < words; ++i)
+            limbs[i] = 0;
+        size += words + 1;
+        trim();
+    }
+
+    constexpr void shift_right_one() {
+        for (std::size_t i = 0; i < size; ++i)
+            limbs[i] = (limbs[i] >> 1) | (i + 1 < size ? limbs[i + 1] << 31 : 0);
+        trim();
+    }
+
+    //Requires other <= *this
+    constexpr void subtract(const BigInteger& other) {
+        std::uint64_t borrow = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            std::uint64_t difference = std::uint64_t(limbs[i]) - (i < other.size ? other.limbs[i] : 0) - borrow;
+            limbs[i] = std::uint32_t(difference);
+            borrow = difference >> 63;
+        }
+        trim();
+    }
+
+    constexpr int compare(const BigInteger& other) const {
+        if (size != other.size)
+            return size < other.size ? -1 : 1;
+        for (std::size_t i = size; i-- > 0;)
+            if (limbs[i] != other.limbs[i])
+                return limbs[i] < other.limbs[i] ? -1 : 1;
+        return 0;
+    }
+
+    constexpr std::size_t bit_length() const {
+        std::size_t bits = size ? 32 * (size - 1) : 0;
+        for (std::uint32_t top = size ? limbs[size - 1] : 0; top; top >>= 1)
+            ++bits;
+        return bits;
+    }
+
+    constexpr bool bit(std::size_t i) const {
+        return i / 32 < size && (limbs[i / 32] >> (i % 32)) & 1;
+    }
+
+    //Highest 64 bits as q with q * 2^exponent <= *this, sticky tells whether any bit below them is set
+    constexpr std::uint64_t top_bits(int& exponent, bool& sticky) const {
+        int bits = int(bit_length());
+        std::uint64_t q = 0;
+        for (int i = bits - 1; i >= bits - 64; --i)
+            q = (q << 1) | (i >= 0 && bit(std::size_t(i)));
+        exponent = bits - 64;
+        sticky = false;
+        for (int i = 0; i < bits - 64; ++i)
+            sticky = sticky || bit(std::size_t(i));
+        return q;
+    }
+
+private:
+    constexpr void trim() {
+        while (size && !limbs[size - 1])
+            --size;
+    }
+};
+
+//numerator / divisor for a quotient below 2^64, sticky is set when the division leaves a remainder
+constexpr std::uint64_t quotient(BigInteger numerator, BigInteger divisor, bool& sticky) {
+    divisor.shift_left(63);
+    std::uint64_t q = 0;
+    for (int i = 63; i >= 0; --i, divisor.shift_right_one()) {
+        if (numerator.compare(divisor) >= 0) {
+            numerator.subtract(divisor);
+            q |= std::uint64_t(1) << i;
+        }
+    }
+    sticky = numerator.size != 0;
+    return q;
+}
+
+struct Number {
+    double value;
+    bool overflow;
+};
+
+//q * 2^exponent (top bit of q set, sticky if the exact value is a bit larger) to the nearest double, ties to even
+constexpr Number round_to_double(std::uint64_t q, int exponent, bool sticky) {
+    // Bits below the 53 of a double, more for a subnormal result
+    int top = exponent + 63;
+    int shift = top < -1022 ? 11 + (-1022 - top) : 11;
+    if (shift > 64)
+        return { 0.0, false };
+    std::uint64_t mantissa = shift == 64 ? 0 : q >> shift;
+    std::uint64_t rest = shift == 64 ? q : q & ((std::uint64_t(1) << shift) - 1);
+    std::uint64_t half = std::uint64_t(1) << (shift - 1);
+    if (rest > half || (rest == half && (sticky || (mantissa & 1))))
+        ++mantissa;
+    exponent += shift;
+    if (mantissa == std::uint64_t(1) << 53) {
+        mantissa >>= 1;
+        ++exponent;
+    }
+    if (exponent + 52 > 1023)
+        return { 0.0, true };
+    // Every step is exact, the result is representable and so is every value on the way there
+    double value = double(mantissa);
+    for (; exponent > 0; --exponent)
+        value *= 2.0;
+    for (; exponent < 0; ++exponent)
+        value *= 0.5;
+    return { value, false };
+}
+
+//Value of a number like number_end() accepts it, overflow is set if it is too large for a double
+//Too small ones become zero (or the nearest subnormal) like in the runtime parser
+constexpr Number number_value(std::string_view text) {
+    // Enough significant digits to round every double correctly, see "Number Parsing at a Gigabyte per Second"
+    constexpr int max_digits = 768;
+    std::size_t pos = 0;
+    bool negative = false;
+    if (at(text, pos) == '+' || at(text, pos) == '-')
+        negative = at(text, pos++) == '-';
+
+    BigInteger mantissa;
+    std::uint64_t small = 0;
+    int scale = 0, digits = 0;
+    bool truncated = false;
+    for (bool fraction = false; pos < text.size(); ++pos) {
+        if (text[pos] == '.') {
+            fraction = true;
+            continue;
+        }
+        if (!is_digit(text[pos]))
+            break;
+        std::uint32_t digit = std::uint32_t(text[pos] - '0');
+        if (digits == 0 && digit == 0) {
+            scale -= fraction;
+        } else if (digits < max_digits) {
+            mantissa.multiply_add(10, digit);
+            small = small * 10 + digit;
+            ++digits;
+            scale -= fraction;
+        } else {
+            truncated = truncated || digit != 0;
+            scale += !fraction;
+        }
+    }
+    if (at(text, pos) == 'e' || at(text, pos) == 'E') {
+        ++pos;
+        bool negative_exponent = false;
+        if (at(text, pos) == '+' || at(text, pos) == '-')
+            negative_exponent = at(text, pos++) == '-';
+        int exponent = 0;
+        for (; is_digit(at(text, pos)); ++pos)
+            if (exponent < 100000)
+                exponent = exponent * 10 + (text[pos] - '0');
+        scale += negative_exponent ? -exponent : exponent;
+    }
+    // A nonzero digit after the kept ones makes the value larger than the kept digits, one more 1 digit says the same
+    if (truncated) {
+        mantissa.multiply_add(10, 1);
+        ++digits;
+        --scale;
+    }
+    const double sign = negative ? -1.0 : 1.0;
+
+    // The value lies in [10^(magnitude - 1), 10^magnitude), which bounds the size of the BigIntegers below
+    int magnitude = digits + scale;
+    if (digits == 0 || magnitude < -324)
+        return { sign * 0.0, false };
+    if (magnitude > 310)
+        return { 0.0, true };
+
+    if (digits <= 19 && small <= std::uint64_t(1) << 53 && scale >= -22 && scale <= 22) {
+        double power = 1.0;
+        for (int i = 0; i < (scale < 0 ? -scale : scale); ++i)
+            power *= 10.0;
+        return { sign * (scale < 0 ? double(small) / power : double(small) * power), false };
+    }
+
+    int exponent = 0;
+    bool sticky = false;
+    std::uint64_t q = 0;
+    if (scale >= 0) {
+        mantissa.multiply_power10(scale);
+        q = mantissa.top_bits(exponent, sticky);
+    } else {
+        BigInteger divisor(1);
+        divisor.multiply_power10(-scale);
+        // 2^shift brings the quotient into [2^63, 2^64), the first guess can be one bit short
+        int shift = 63 + int(divisor.bit_length()) - int(mantissa.bit_length());
+        do {
+            BigInteger numerator = mantissa, denominator = divisor;
+            if (shift > 0)
+                numerator.shift_left(std::size_t(shift));
+            else
+                denominator.shift_left(std::size_t(-shift));
+            q = quotient(numerator, denominator, sticky);
+            exponent = -shift++;
+        } while (!(q >> 63));
+    }
+    Number number = round_to_double(q, exponent, sticky);
+    number.value *= sign;
+    return number;
+}
+
+/******************************************************************************/
+// Variables: every distinct identifier in order of its first appearance, numbers are skipped so "1e5" is no variable
+
+template<typename Visitor>
+constexpr void for_each_identifier(std::string_view text, Visitor&& visit) {
+    for (std::size_t pos = 0; pos < text.size();) {
+        if (is_alpha(text[pos])) {
+            std::size_t end = identifier_end(text, pos);
+            visit(text.substr(pos, end - pos));
+            pos = end;
+        } else if (is_digit(text[pos]) || text[pos] == '.') {
+            pos = number_end(text, pos);
+        } else {
+            ++pos;
+        }
+    }
+}
+
+//Names without their spaces one after another in chars, name i is [offsets[i], offsets[i + 1])
+template<std::size_t N>
+struct VariableList {
+    std::array<char, N + 1> chars{};
+    std::array<std::size_t, N + 2> offsets{};
+    std::size_t size = 0;
+
+    constexpr std::string_view name(std::size_t i) const {
+        return std::string_view(chars.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    constexpr std::size_t find(std::string_view wanted) const {
+        for (std::size_t i = 0; i < size; ++i)
+            if (same_name(name(i), wanted))
+                return i;
+        return size;
+    }
+
+    constexpr void add(std::string_view written) {
+        std::size_t end = offsets[size];
+        for (char c : written)
+            if (!is_space(c))
+                chars[end++] = c;
+        offsets[++size] = end;
+    }
+};
+
+//Upper bound is the length of the text, each identifier takes at least one character
+template<typename Source>
+constexpr auto collect_variables() {
+    constexpr std::string_view text = Source::get();
+    VariableList<text.size()> list;
+    for_each_identifier(text, [&list](std::string_view name) {
+        if (list.find(name) == list.size)
+            list.add(name);
+    });
+    return list;
+}
+
+template<typename Source>
+constexpr std::size_t variable_index(std::string_view name) {
+    return collect_variables<Source>().find(name);
+}
+
+/******************************************************************************/
+// The expression tree, one type per Node, eval() is static so everything inlines into the caller
+
+template<typename Source, std::size_t Begin, std::size_t End>
+struct Constant {
+    static constexpr Number number = number_value(Source::get().substr(Begin, End - Begin));
+    static constexpr double value = number.value;
+
+    static constexpr double eval(const double*) {
+        return value;
+    }
+};
+
+template<std::size_t Index>
+struct Variable {
+    static constexpr double eval(const double* values) {
+        return values[Index];
+    }
+};
+
+template<char Operator, typename Left, typename Right>
+struct Binary {
+    static constexpr double eval(const double* values) {
+        if constexpr (Operator == '+')
+            return Left::eval(values) + Right::eval(values);
+        else if constexpr (Operator == '-')
+            return Left::eval(values) - Right::eval(values);
+        else if constexpr (Operator == '*')
+            return Left::eval(values) * Right::eval(values);
+        else if constexpr (Operator == '/')
+            return Left::eval(values) / Right::eval(values);
+        else if constexpr (Operator == '^')
+            return pow(Left::eval(values), Right::eval(values));
+        else if constexpr (Operator == 'A')
+            return bool(Left::eval(values)) && bool(Right::eval(values));
+        else
+            return bool(Left::eval(values)) || bool(Right::eval(values));
+    }
+};
+
+/******************************************************************************/
+// The parser: every rule is a template of the source and the position, its result is the type and the end position
+//      term = product, { ("+" | "-"), product }
+//      product = power, { ("*" | "/" | "&&" | "||"), power }
+//      power = factor, [ "^", power ]
+//      factor = group | varname | double-number
+//      group = "(", term, ")"
+
+enum class FactorKind { Group, Variable, Number };
+
+constexpr FactorKind factor_kind(std::string_view text, std::size_t pos) {
+    char c = at(text, skip_space(text, pos));
+    return c == '(' ? FactorKind::Group : is_alpha(c) ? FactorKind::Variable : FactorKind::Number;
+}
+
+//Operator at pos (after spaces) as the character the Node templates use, '\0' if the rule ends there
+constexpr char term_operator(std::string_view text, std::size_t pos) {
+    char c = at(text, skip_space(text, pos));
+    return c == '+' || c == '-' ? c : '\0';
+}
+
+constexpr char product_operator(std::string_view text, std::size_t pos) {
+    pos = skip_space(text, pos);
+    char c = at(text, pos);
+    if (c == '*' || c == '/')
+        return c;
+    if (c == '&' && at(text, pos + 1) == '&')
+        return 'A';
+    if (c == '|' && at(text, pos + 1) == '|')
+        return 'O';
+    return '\0';
+}
+
+constexpr std::size_t operator_end(std::string_view text, std::size_t pos, char op) {
+    return skip_space(text, pos) + (op == 'A' || op == 'O' ? 2 : 1);
+}
+
+template<typename Source, std::size_t Pos>
+struct ParseTerm;
+
+template<typename Source, std::size_t Pos, FactorKind Kind = factor_kind(Source::get(), Pos)>
+struct ParseFactor;
+
+template<typename Source, std::size_t Pos>
+struct ParseFactor<Source, Pos, FactorKind::Group> {
+    using inner = ParseTerm<Source, skip_space(Source::get(), Pos) + 1>;
+    static constexpr std::size_t close = skip_space(Source::get(), inner::end);
+    static_assert(at(Source::get(), close) == ')', "SP_EXPR: missing ')'");
+
+    using type = typename inner::type;
+    static constexpr std::size_t end = close + 1;
+};
+
+template<typename Source, std::size_t Pos>
+struct ParseFactor<Source, Pos, FactorKind::Variable> {
+    static constexpr std::size_t begin = skip_space(Source::get(), Pos);
+    static constexpr std::size_t end = identifier_end(Source::get(), begin);
+
+    using type = Variable<variable_index<Source>(Source::get().substr(begin, end - begin))>;
+};
+
+template<typename Source, std::size_t Pos>
+struct ParseFactor<Source, Pos, FactorKind::Number> {
+    static constexpr std::size_t begin = skip_space(Source::get(), Pos);
+    static constexpr std::size_t end = number_end(Source::get(), begin);
+
+    using type = Constant<Source, begin, end>;
+    static_assert(!type::number.overflow, "SP_EXPR: number too large for a double");
+};
+
+constexpr bool power_operator(std::string_view text, std::size_t pos) {
+    return at(text, skip_space(text, pos)) == '^';
+}
+
+// Right associative: the right operand of ^ is the whole power rule after it
+template<typename Source, std::size_t Pos, bool Chained = power_operator(Source::get(), ParseFactor<Source, Pos>::end)>
+struct ParsePower {
+    using base = ParseFactor<Source, Pos>;
+    using exponent = ParsePower<Source, operator_end(Source::get(), base::end, '^')>;
+
+    using type = Binary<'^', typename base::type, typename exponent::type>;
+    static constexpr std::size_t end = exponent::end;
+};
+
+template<typename Source, std::size_t Pos>
+struct ParsePower<Source, Pos, false> {
+    using base = ParseFactor<Source, Pos>;
+
+    using type = typename base::type;
+    static constexpr std::size_t end = base::end;
+};
+
+// Left associative tails: every operator wraps what was parsed so far and continues after its right operand
+template<typename Source, typename Left, std::size_t Pos, char Operator = product_operator(Source::get(), Pos)>
+struct ProductTail {
+    using right = ParsePower<Source, operator_end(Source::get(), Pos, Operator)>;
+    using next = ProductTail<Source, Binary<Operator, Left, typename right::type>, right::end>;
+
+    using type = typename next::type;
+    static constexpr std::size_t end = next::end;
+};
+
+template<typename Source, typename Left, std::size_t Pos>
+struct ProductTail<Source, Left, Pos, '\0'> {
+    using type = Left;
+    static constexpr std::size_t end = Pos;
+};
+
+template<typename Source, std::size_t Pos>
+struct ParseProduct {
+    using first = ParsePower<Source, Pos>;
+    using tail = ProductTail<Source, typename first::type, first::end>;
+
+    using type = typename tail::type;
+    static constexpr std::size_t end = tail::end;
+};
+
+template<typename Source, typename Left, std::size_t Pos, char Operator = term_operator(Source::get(), Pos)>
+struct TermTail {
+    using right = ParseProduct<Source, operator_end(Source::get(), Pos, Operator)>;
+    using next = TermTail<Source, Binary<Operator, Left, typename right::type>, right::end>;
+
+    using type = typename next::type;
+    static constexpr std::size_t end = next::end;
+};
+
+template<typename Source, typename Left, std::size_t Pos>
+struct TermTail<Source, Left, Pos, '\0'> {
+    using type = Left;
+    static constexpr std::size_t end = Pos;
+};
+
+template<typename Source, std::size_t Pos>
+struct ParseTerm {
+    using first = ParseProduct<Source, Pos>;
+    using tail = TermTail<Source, typename first::type, first::end>;
+
+    using type = typename tail::type;
+    static constexpr std::size_t end = tail::end;
+};
+
+/******************************************************************************/
+
+// What SP_EXPR returns: an empty object whose call operator is the inlined tree
+template<typename Source, typename Tree>
+struct Expression {
+    static constexpr auto variable_list = collect_variables<Source>();
+    static constexpr std::size_t variable_count = variable_list.size;
+
+    //Names of the positional arguments
+    static constexpr std::array<std::string_view, variable_count> variables = [] {
+        std::array<std::string_view, variable_count> names{};
+        for (std::size_t i = 0; i < variable_count; ++i)
+            names[i] = variable_list.name(i);
+        return names;
+    }();
+
+    template<typename ... Values>
+    constexpr double operator()(Values ... values) const {
+        static_assert(sizeof...(Values) == variable_count, "SP_EXPR: one argument per variable expected");
+        const double arguments[] = { double(values) ..., 0.0 };
+        return Tree::eval(arguments);
+    }
+
+    //Values in the order of variables
+    constexpr double evaluate(const double* values) const {
+        return Tree::eval(values);
+    }
+};
+
+template<typename Source>
+constexpr auto make(Source) {
+    using parsed = ParseTerm<Source, 0>;
+    static_assert(skip_space(Source::get(), parsed::end) == Source::get().size(), "SP_EXPR: unparseable input");
+    return Expression<Source, typename parsed::type>{};
+}
+
+}
+
+// The literal is wrapped in a local type, so it can be used as a template argument for the parser
+#define SP_EXPR(text) ::sp_expr::make([] { \
+        struct Source { static constexpr std::string_view get() { return text; } }; \
+        return Source{}; \
+    }())
@@ -0,0 +1,45 @@
+// Compile time checks of sp_expr.hpp, make check compiles this file and every static_assert is one check
+// The expected numbers are C++ literals, which the compiler rounds exactly like from_chars does at runtime
+
+#include "sp_expr.hpp"
+
+#include <limits>
+
+// Fast path: up to 19 digits and powers of ten up to 22
+static_assert(SP_EXPR("0.1")() == 0.1, "");
+static_assert(SP_EXPR(".5e-3")() == .5e-3, "");
+static_assert(SP_EXPR("9007199254740992")() == 9007199254740992.0, "");
+static_assert(SP_EXPR("2*-1")() == -2.0, "");
+
+// Beyond it the naive power of ten rounds twice
+static_assert(SP_EXPR("1e23")() == 1e23, "");
+static_assert(SP_EXPR("8.589973e9")() == 8.589973e9, "");
+static_assert(SP_EXPR("0.3e-30")() == 0.3e-30, "");
+static_assert(SP_EXPR("123456789012345678901234567890")() == 123456789012345678901234567890.0, "");
+static_assert(SP_EXPR("3.141592653589793238462643383279502884")() == 3.141592653589793238462643383279502884, "");
+
+// Ties go to even, digits far behind the tie still decide
+static_assert(SP_EXPR("9007199254740993")() == 9007199254740992.0, "");
+static_assert(SP_EXPR("9007199254740995")() == 9007199254740996.0, "");
+static_assert(SP_EXPR("9007199254740993.00000000000000000000000000000001")() == 9007199254740994.0, "");
+
+// Limits of double, subnormals and underflow to zero
+static_assert(SP_EXPR("1.7976931348623157e308")() == std::numeric_limits<double>::max(), "");
+static_assert(SP_EXPR("1.7976931348623158e308")() == std::numeric_limits<double>::max(), "");
+static_assert(SP_EXPR("2.2250738585072014e-308")() == std::numeric_limits<double>::min(), "");
+static_assert(SP_EXPR("2.2250738585072011e-308")() == 2.2250738585072011e-308, "");
+static_assert(SP_EXPR("4.9406564584124654e-324")() == std::numeric_limits<double>::denorm_min(), "");
+static_assert(SP_EXPR("2.4703282292062328e-324")() == std::numeric_limits<double>::denorm_min(), "");
+static_assert(SP_EXPR("2.4703282292062327e-324")() == 0.0, "");
+static_assert(SP_EXPR("1e-400")() == 0.0, "");
+static_assert(SP_EXPR("0e999")() == 0.0, "");
+// "1e400" and "1.7976931348623159e308" do not compile, the runtime parser rejects them as well
+
+// Names go on across spaces like in the runtime parser
+static_assert(SP_EXPR("a b + ab")(1.0) == 2.0, "");
+static_assert(SP_EXPR("a b + ab").variables.size() == 1 && SP_EXPR("a b + ab").variables[0] == "ab", "");
+static_assert(SP_EXPR("x 2 * x2 - y")(3.0, 1.0) == 8.0, "");
+
+// Operators
+static_assert(SP_EXPR("8 - 2 - 1")() == 5.0 && SP_EXPR("8 / 2 / 2")() == 2.0, "");
+static_assert(SP_EXPR("(1 || 0) + (2 && 0) * x")(5.0) == 1.0, "");